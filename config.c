@@ -504,7 +504,7 @@ static void ApplyConfiguration(char reloadkickstart)
       BootPrint(s);
       siprintf(s, "Offset: %ld", hdf[i].offset);
       BootPrint(s);
-      if (hdf[i].type & HDF_FILE && !hdf[i].idxfile->file.cltbl) idxfail = 1;
+      if (hdf[i].type & HDF_FILE && !hdf[i].idxfile->clmt && !hdf[i].idxfile->ckpts) idxfail = 1;
     }
   }
   if (idxfail)
@@ -633,6 +633,7 @@ unsigned char SaveConfiguration(char *filename)
 }
 
 void EjectAllFloppies() {
+  FlushTrackCache();
   for(int i=0;i<drives;i++)
     df[i].status = 0;
 
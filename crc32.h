@@ -0,0 +1,10 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stdint.h>
+
+// Initial CRC value is -1 (0xFFFFFFFF)
+// Final CRC value is bitwise negation of the last calculated value
+uint32_t CalculateCRC32(uint32_t crc, const unsigned char *pBuffer, uint32_t nSize);
+
+#endif
@@ -0,0 +1,283 @@
+// cue_bench.c
+// Host benchmark of the CD sector read path
+//
+// Replays LBA access traces against a .cue/.bin (or .iso) image through
+// cue_parser.c. The parser runs on a small FatFs shim over host files
+// which counts seeks and models the SD card traffic of FatFs: partially
+// read sectors stay in the file buffer, everything else is a card read.
+//
+// usage: cuebench [-d] <image.cue> [trace...]
+//   -d:    read through cue_readsector() directly, bypassing the read-ahead
+//          ring, to compare against the path without CUE_READAHEAD_SECTORS
+//   trace: seq  - stream the first data track
+//          xa   - every 8th sector of the first data track (XA audio channel)
+//          boot - random seeks with short runs, like a game boot
+//          or a file with one "lba [count]" request per line (# comments)
+//   without traces all three built-in patterns are run
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "cue_parser.h"
+
+#define SEQ_SECTORS   20000
+#define XA_SECTORS    4000
+#define XA_STRIDE     8
+#define BOOT_REQUESTS 2000
+#define BOOT_MAX_RUN  16
+
+unsigned char sector_buffer[SECTOR_BUFFER_SIZE];
+
+typedef struct {
+	int lba;
+	int count;
+} request_t;
+
+static UINT (*readsector)(int lba, int ofs, unsigned char *buf, UINT len) = cue_readsector_ra;
+
+static struct {
+	unsigned long lseeks;
+	unsigned long reads;
+	unsigned long commands;     // card read commands
+	unsigned long long bytes;   // bytes read from the card
+} bench;
+
+//// FatFs shim ////
+// obj.sclust holds the index of the host file + 1, so exchanging the
+// object id of a FIL (as cue_gettrackfile does) switches the host file
+#define MAX_HOST_FILES (CUE_MAX_FILES + 1)
+static FILE *host_file[MAX_HOST_FILES];
+
+FRESULT f_open(FIL* fp, const TCHAR* path, BYTE mode) {
+	int i;
+	FILE *f;
+
+	for (i = 0; i < MAX_HOST_FILES && host_file[i]; i++);
+	if (i == MAX_HOST_FILES) return FR_TOO_MANY_OPEN_FILES;
+	if (!(f = fopen(path, "rb"))) return FR_NO_FILE;
+
+	memset(fp, 0, sizeof(FIL));
+	fseeko(f, 0, SEEK_END);
+	fp->obj.objsize = ftello(f);
+	fp->obj.sclust = i + 1;
+	fp->flag = mode;
+	host_file[i] = f;
+	return FR_OK;
+}
+
+FRESULT f_close(FIL* fp) {
+	if (fp->obj.sclust && host_file[fp->obj.sclust - 1]) {
+		fclose(host_file[fp->obj.sclust - 1]);
+		host_file[fp->obj.sclust - 1] = 0;
+	}
+	fp->obj.sclust = 0;
+	return FR_OK;
+}
+
+// card sectors needed to read len bytes from pos
+static void card_read(FIL *fp, FSIZE_t pos, UINT len) {
+	LBA_t first = pos >> 9;
+	LBA_t last = (pos + len - 1) >> 9;
+
+	if (fp->sect == first + 1) first++; // still in the file buffer
+	if (first <= last) {
+		bench.commands++;
+		bench.bytes += (last - first + 1) << 9;
+	}
+	// a partially read last sector is kept in the buffer
+	fp->sect = ((pos + len) & 511) ? last + 1 : 0;
+}
+
+FRESULT f_read(FIL* fp, void* buff, UINT btr, UINT* br) {
+	FILE *f = host_file[fp->obj.sclust - 1];
+
+	*br = 0;
+	if (fp->fptr >= fp->obj.objsize) return FR_OK;
+	if (btr > fp->obj.objsize - fp->fptr) btr = fp->obj.objsize - fp->fptr;
+
+	bench.reads++;
+	card_read(fp, fp->fptr, btr);
+	fseeko(f, fp->fptr, SEEK_SET);
+	*br = fread(buff, 1, btr, f);
+	fp->fptr += *br;
+	return FR_OK;
+}
+
+FRESULT f_lseek(FIL* fp, FSIZE_t ofs) {
+	if (ofs == CREATE_LINKMAP) {
+		// one fragment: size, length, start cluster, terminator
+		fp->cltbl[0] = 4;
+		return FR_OK;
+	}
+	bench.lseeks++;
+	fp->fptr = ofs > fp->obj.objsize ? fp->obj.objsize : ofs;
+	return FR_OK;
+}
+
+unsigned char IDXOpen(IDXFile *file, const char *name, char mode) {
+	return f_open(&file->file, name, mode);
+}
+
+void IDXClose(IDXFile *file) {
+	f_close(&file->file);
+}
+
+DWORD IDXIndexAt(IDXFile *pIDXF, BYTE idx, BYTE files) {
+	static DWORD pool[IDX_POOL_SIZE];
+	DWORD offset = idx ? pIDXF->tblsize : 0;
+
+	pIDXF->ckpts = 0;
+	if (offset >= IDX_POOL_SIZE) {
+		pIDXF->file.cltbl = 0;
+		return 0;
+	}
+	pIDXF->clmt = pool;
+	pool[offset] = IDX_POOL_SIZE - offset;
+	pIDXF->file.cltbl = &pool[offset];
+	f_lseek(&pIDXF->file, CREATE_LINKMAP);
+	pIDXF->tblsize = offset + pIDXF->file.cltbl[0];
+	return pIDXF->file.cltbl[0];
+}
+
+unsigned char IDXSeekPos(IDXFile *file, FSIZE_t ofs) {
+	return f_lseek(&file->file, ofs);
+}
+
+void IDXIndex(IDXFile *pIDXF) {
+	IDXIndexAt(pIDXF, 0, 1);
+}
+
+const char *GetExtension(const char *fileName) {
+	const char *ext = strrchr(fileName, '.');
+	return ext ? ext + 1 : 0;
+}
+
+//// traces ////
+static int first_data_track() {
+	for (int i = 0; i < toc.last; i++)
+		if (toc.tracks[i].type != SECTOR_AUDIO) return i;
+	return 0;
+}
+
+static int trace_seq(request_t *req) {
+	cd_track_t *t = &toc.tracks[first_data_track()];
+	int len = t->end - t->start;
+
+	req[0].lba = t->start;
+	req[0].count = len < SEQ_SECTORS ? len : SEQ_SECTORS;
+	return 1;
+}
+
+static int trace_xa(request_t *req) {
+	cd_track_t *t = &toc.tracks[first_data_track()];
+	int n = 0;
+
+	for (int lba = t->start; lba < t->end && n < XA_SECTORS; lba += XA_STRIDE) {
+		req[n].lba = lba;
+		req[n++].count = 1;
+	}
+	return n;
+}
+
+static int trace_boot(request_t *req) {
+	unsigned int seed = 12345;
+
+	for (int n = 0; n < BOOT_REQUESTS; n++) {
+		seed = seed * 1103515245 + 12345;
+		req[n].lba = (seed >> 8) % toc.end;
+		seed = seed * 1103515245 + 12345;
+		req[n].count = 1 + (seed >> 8) % BOOT_MAX_RUN;
+		if (req[n].lba + req[n].count > toc.end) req[n].count = toc.end - req[n].lba;
+	}
+	return BOOT_REQUESTS;
+}
+
+static int trace_file(const char *name, request_t **req) {
+	char line[128];
+	int n = 0, size = 1024, lba, count;
+	FILE *f = fopen(name, "r");
+
+	if (!f) return -1;
+	*req = realloc(*req, size * sizeof(request_t));
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#') continue;
+		count = 1;
+		if (sscanf(line, "%d %d", &lba, &count) < 1) continue;
+		if (n == size) {
+			size *= 2;
+			*req = realloc(*req, size * sizeof(request_t));
+		}
+		(*req)[n].lba = lba;
+		(*req)[n++].count = count;
+	}
+	fclose(f);
+	return n;
+}
+
+//// replay ////
+static void replay(const char *name, request_t *req, int n) {
+	static unsigned char buf[2352];
+	struct timespec t0, t1;
+	unsigned long sectors = 0;
+	double secs;
+
+	memset(&bench, 0, sizeof(bench));
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int i = 0; i < n; i++) {
+		for (int lba = req[i].lba; lba < req[i].lba + req[i].count; lba++) {
+			int track = cue_gettrackbylba(lba);
+			readsector(lba, 0, buf, toc.tracks[track].sector_size ? toc.tracks[track].sector_size : 2352);
+			sectors++;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	printf("%-12s %9lu %12.0f %9lu %9lu %10lu %14llu\n", name, sectors,
+	       secs > 0 ? sectors / secs : 0, bench.lseeks, bench.reads, bench.commands, bench.bytes);
+}
+
+int main(int argc, char **argv) {
+	static const char *builtin[] = { "seq", "xa", "boot" };
+	static IDXFile image;
+	request_t *req = 0;
+	const char **traces;
+	int ntraces, n;
+
+	if (argc > 1 && !strcmp(argv[1], "-d")) {
+		readsector = cue_readsector;
+		argc--;
+		argv++;
+	}
+	if (argc < 2) {
+		printf("usage: %s [-d] <image.cue> [seq|xa|boot|tracefile...]\n", argv[0]);
+		return 1;
+	}
+	if (cue_parse(argv[1], &image) != CUE_RES_OK) {
+		printf("Error parsing %s\n", argv[1]);
+		return 1;
+	}
+
+	traces = argc > 2 ? (const char **)&argv[2] : builtin;
+	ntraces = argc > 2 ? argc - 2 : 3;
+	printf("read path: %s\n", readsector == cue_readsector ? "cue_readsector" : "cue_readsector_ra");
+	req = malloc((BOOT_REQUESTS > XA_SECTORS ? BOOT_REQUESTS : XA_SECTORS) * sizeof(request_t));
+
+	printf("\n%-12s %9s %12s %9s %9s %10s %14s\n", "trace", "sectors", "sectors/s", "lseeks", "reads", "card cmds", "card bytes");
+	for (int i = 0; i < ntraces; i++) {
+		if (!strcmp(traces[i], "seq")) n = trace_seq(req);
+		else if (!strcmp(traces[i], "xa")) n = trace_xa(req);
+		else if (!strcmp(traces[i], "boot")) n = trace_boot(req);
+		else n = trace_file(traces[i], &req);
+		if (n < 0) {
+			printf("%-12s cannot open trace\n", traces[i]);
+			continue;
+		}
+		replay(traces[i], req, n);
+	}
+	free(req);
+	return 0;
+}
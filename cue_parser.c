@@ -8,6 +8,7 @@
 #include "cue_parser.h"
 #ifdef CUE_PARSER_TEST
 #define cue_parser_debugf(a, ...) printf(a"\n", ## __VA_ARGS__)
+const char *GetExtension(const char *fileName);
 #else
 #include "debug.h"
 #include "idxfile.h"
@@ -57,9 +58,22 @@ char  sector_buffer[512] = {0};
 int   cue_size = 0;
 #else
 static FIL cue_file;
+
+#if CUE_READAHEAD_SECTORS
+// read-ahead of whole sectors for streaming reads. The sectors of one
+// track are kept in a ring, ra_first in slot ra_head.
+static unsigned char ra_buf[CUE_READAHEAD_SECTORS * 2352] __attribute__ ((aligned (4)));
+static int ra_track = -1; // track of the buffered sectors
+static int ra_first;      // first buffered lba
+static int ra_head;
+static int ra_count;      // buffered sectors
+static int ra_slots;      // size of the ring in sectors of the track
+static int ra_depth;      // sectors to read next, doubled while the stream continues
+#endif
 #endif
 
 static int cue_pt = 0;
+static int cue_track = 0; // track of the last lookup
 
 toc_t toc;
 
@@ -117,6 +131,43 @@ static char cue_getch()
   else return sector_buffer[(cue_pt++)&0x1ff];
 }
 
+#ifdef CUE_PARSER_TEST
+static long long cue_binsize(const char *name)
+{
+  long long size;
+  FILE *fp = fopen(name, "rb");
+
+  if (!fp) return 0;
+  fseek(fp, 0L, SEEK_END);
+  size = ftell(fp);
+  fclose(fp);
+  return size;
+}
+#else
+static int cue_files; // .bin files of the cue sheet
+
+// open the next .bin file into the image, and index it into its share of
+// the image's cluster link map
+static char cue_openbin(const char *name, IDXFile *image)
+{
+  cd_file_t *bin;
+
+  if (toc.files == CUE_MAX_FILES) return CUE_RES_UNS;
+  if (IDXOpen(image, name, FA_READ) != FR_OK) return CUE_RES_BINERR;
+
+  IDXIndexAt(image, toc.files, cue_files);
+  bin = &toc.bin[toc.files];
+  bin->obj = image->file.obj;
+  bin->cltbl = image->file.cltbl;
+  bin->ckpt = image->ckpt;
+  bin->ckpts = image->ckpts;
+  bin->ckshift = image->ckshift;
+  toc.size += f_size(&image->file);
+  toc.curfile = toc.files++;
+  return CUE_RES_OK;
+}
+#endif
+
 static int cue_getword(char* word)
 {
   char c;
@@ -133,6 +184,24 @@ static int cue_getword(char* word)
   return c==0 ? CUE_EOT : i == 0 ? CUE_NOWORD : literal ? 1 : 0;
 }
 
+#ifndef CUE_PARSER_TEST
+// number of .bin files in the cue sheet, so the index pool can be shared
+// between them before the first one is indexed
+static int cue_countfiles()
+{
+  char word[CUE_WORD_SIZE];
+  int word_status, files = 0;
+
+  cue_pt = 0;
+  do {
+    word_status = cue_getword(word);
+    if (!word_status && !strcmp(word, TOKEN_FILE)) files++;
+  } while (word_status != CUE_EOT);
+  f_lseek(&cue_file, 0);
+  return files;
+}
+#endif
+
 //// cue_parse() ////
 #ifdef CUE_PARSER_TEST
 char cue_parse(const char *filename)
@@ -144,11 +213,21 @@ char cue_parse(const char *filename, IDXFile *image)
   int word_status;
   char mode = 0, submode = 0, error = CUE_RES_OK, index = 0, bin_valid = 0;
   int track = 0, x, pregap = 0, tracklen;
+  int file = -1, filebase = 0;
+  long long binsize = 0;
   msf_t msf;
   int lba, lastindex1 = 0;
   char e[3];
 
   memset(&toc, 0, sizeof(toc));
+  cue_track = 0;
+  #ifndef CUE_PARSER_TEST
+  toc.file = image;
+  cue_files = 1;
+  #if CUE_READAHEAD_SECTORS
+  ra_track = -1;
+  #endif
+  #endif
 
   const char *ext = GetExtension(filename);
   e[0] = e[1] = e[2] = ' ';
@@ -162,14 +241,15 @@ char cue_parse(const char *filename, IDXFile *image)
     #ifdef CUE_PARSER_TEST
     bin_valid = 1;
     #else
-    toc.file = image;
-    if (IDXOpen(toc.file, filename, FA_READ) == FR_OK) {
+    if (cue_openbin(filename, image) == CUE_RES_OK) {
       bin_valid = 1;
+      binsize = f_size(&image->file);
       track = 1;
       toc.tracks[0].sector_size = 2048;
       toc.tracks[0].type = SECTOR_DATA_MODE1;
       toc.tracks[0].offset = 0;
       toc.tracks[0].start = 0;
+      toc.tracks[0].file = 0;
     } else {
       error = CUE_RES_BINERR;
     }
@@ -191,6 +271,7 @@ char cue_parse(const char *filename, IDXFile *image)
     fseek(cue_fp, 0L, SEEK_SET);
     #else
     cue_parser_debugf("Opened file %s with size %llu bytes.", filename, f_size(&cue_file));
+    cue_files = cue_countfiles();
     #endif
     cue_pt = 0;
 
@@ -212,22 +293,24 @@ char cue_parse(const char *filename, IDXFile *image)
             if (submode == 0) {
               pregap = 0;
               cue_parser_debugf("Filename: %s", word);
-              if (bin_valid) {
-                // only one .bin supported
-                error = CUE_RES_UNS;
-              } else {
-              #ifdef CUE_PARSER_TEST
-                bin_valid = 1;
+              // the end of the previous file ends its last track, and the
+              // following tracks are placed after it
+              if (track > 0 && toc.tracks[track - 1].sector_size) {
+                filebase = toc.tracks[track - 1].start + (binsize - toc.tracks[track - 1].offset) / toc.tracks[track - 1].sector_size;
+                if (!toc.tracks[track - 1].end) toc.tracks[track - 1].end = filebase;
               }
+              file++;
+              #ifdef CUE_PARSER_TEST
+              binsize = cue_binsize(word);
+              bin_valid = 1;
               #else
-                toc.file = image;
-                if (IDXOpen(toc.file, word, FA_READ) == FR_OK)
-                  bin_valid = 1;
-                else
-                  error = CUE_RES_BINERR;
+              error = cue_openbin(word, image);
+              if (!error) {
+                binsize = f_size(&image->file);
+                bin_valid = 1;
               }
               #endif
-              } else if (submode == 1) {
+            } else if (submode == 1) {
               cue_parser_debugf("Filemode: %s", word);
               mode = 0;
             }
@@ -237,7 +320,8 @@ char cue_parse(const char *filename, IDXFile *image)
             if (submode == 0) {
               x = strtol(word, 0, 10);
               cue_parser_debugf("Trackno: %d -> %d (%s)", track, x, word);
-              if (!x || x > 99 || x != (track + 1)) error = CUE_RES_INVALID; else track = x;
+              if (!x || x > 99 || x != (track + 1) || file < 0) error = CUE_RES_INVALID; else track = x;
+              if (!error) toc.tracks[track - 1].file = file;
             } else if (submode == 1) {
               cue_parser_debugf("Trackmode: %s", word);
               if (!strcmp(word, TOKEN_AUDIO)) {
@@ -282,16 +366,17 @@ char cue_parse(const char *filename, IDXFile *image)
                 lba = MSF2LBA(msf.m, msf.s, msf.f);
                 if (index == 0) {
                   if (track > 1 && !toc.tracks[track - 2].end) {
-                    toc.tracks[track - 2].end =  lba + 150 + pregap;
+                    toc.tracks[track - 2].end = filebase + lba + 150 + pregap;
                   }
                 } else if (index == 1) {
-                  toc.tracks[track - 1].start = lba + 150 + pregap;
-                  if (track > 1) {
+                  toc.tracks[track - 1].start = filebase + lba + 150 + pregap;
+                  if (track > 1 && toc.tracks[track - 2].file == toc.tracks[track - 1].file) {
                     tracklen = lba - lastindex1;
                     toc.tracks[track - 1].offset = toc.tracks[track - 2].offset + (tracklen * toc.tracks[track - 2].sector_size);
                     if (!toc.tracks[track-2].end) toc.tracks[track - 2].end = toc.tracks[track - 1].start - 1;
                   } else {
-                    toc.tracks[0].offset = (lba + 150) * toc.tracks[0].sector_size;
+                    // first track in its file
+                    toc.tracks[track - 1].offset = (lba + 150) * toc.tracks[track - 1].sector_size;
                   }
                   lastindex1 = lba;
                 }
@@ -315,38 +400,184 @@ char cue_parse(const char *filename, IDXFile *image)
     #endif
   }
 
-  #ifndef CUE_PARSET_TEST
   if (!bin_valid)
     error = CUE_RES_BINERR;
-  else if (error) 
+  #ifndef CUE_PARSER_TEST
+  else if (error)
     f_close(&toc.file->file);
-  else {
-    IDXIndex(toc.file);
-    if (track > 0) {
-      tracklen = (f_size(&toc.file->file) - toc.tracks[track - 1].offset) / toc.tracks[track - 1].sector_size;
-      toc.tracks[track - 1].end = toc.tracks[track - 1].start + tracklen;
-    }
-  }
   #endif
+  else if (track > 0 && toc.tracks[track - 1].sector_size) {
+    tracklen = (binsize - toc.tracks[track - 1].offset) / toc.tracks[track - 1].sector_size;
+    toc.tracks[track - 1].end = toc.tracks[track - 1].start + tracklen;
+  }
   if (error) {
     toc.last = 0;
   } else {
     toc.last = track;
     toc.end = toc.tracks[track-1].end;
     toc.valid = 1;
+    #ifndef CUE_PARSER_TEST
+    toc.curfile = -1;
+    cue_gettrackfile(0);
+    #endif
   }
 
   iprintf("Tracks in the CUE file %s : %d\n", filename, toc.last);
   for (int i = 0; i < toc.last ; i++) {
     LBA2MSF(toc.tracks[i].start, &msf);
-    iprintf("Track %i, start: %d - %02d:%02d:%02d (%d) end: %d sector size:%d\n",
-      i+1, toc.tracks[i].start, msf.m, msf.s, msf.f, toc.tracks[i].offset, toc.tracks[i].end, toc.tracks[i].sector_size);
+    iprintf("Track %i, start: %d - %02d:%02d:%02d (%d) end: %d sector size:%d file:%d\n",
+      i+1, toc.tracks[i].start, msf.m, msf.s, msf.f, toc.tracks[i].offset, toc.tracks[i].end, toc.tracks[i].sector_size, toc.tracks[i].file);
   }
   return error;
 }
 
+// returns the first track ending after lba, or toc.last if there's none
 int cue_gettrackbylba(int lba) {
-  int index = 0;
-  while ((toc.tracks[index].end <= lba) && (index < toc.last)) index++;
-  return index;
+  int lo = 0, hi = toc.last, mid;
+
+  // most accesses hit the same track again
+  if ((cue_track == toc.last || toc.tracks[cue_track].end > lba) &&
+      (cue_track == 0 || toc.tracks[cue_track - 1].end <= lba))
+    return cue_track;
+
+  while (lo < hi) {
+    mid = (lo + hi) >> 1;
+    if (toc.tracks[mid].end <= lba) lo = mid + 1; else hi = mid;
+  }
+  cue_track = lo;
+  return lo;
 }
+
+#ifndef CUE_PARSER_TEST
+// switch the image to the .bin file of a track. The files share one FIL,
+// only the object id and the link map are exchanged, so no FAT lookup
+// is needed. Returns the file to seek and read.
+FIL *cue_gettrackfile(int track) {
+  FIL *fp = &toc.file->file;
+  int file = toc.tracks[track].file;
+
+  if (file != toc.curfile) {
+    fp->obj = toc.bin[file].obj;
+    fp->cltbl = toc.bin[file].cltbl;
+    toc.file->ckpt = toc.bin[file].ckpt;
+    toc.file->ckpts = toc.bin[file].ckpts;
+    toc.file->ckshift = toc.bin[file].ckshift;
+    toc.file->ckclust = fp->obj.sclust;
+    fp->fptr = 0;
+    fp->clust = 0;
+    fp->sect = 0;
+    fp->err = 0;
+    toc.curfile = file;
+  }
+  return fp;
+}
+
+// read len bytes from the sector at lba, starting at byte ofs of the
+// sector. Sequential reads continue at the current file position without
+// seeking. Areas outside of the image (pregaps not stored in the .bin)
+// read as zeroes. Returns the number of bytes read.
+UINT cue_readsector(int lba, int ofs, unsigned char *buf, UINT len) {
+  int track = cue_gettrackbylba(lba);
+  cd_track_t *t = &toc.tracks[track];
+  FSIZE_t pos;
+  FIL *fp;
+  UINT br = 0;
+
+  if (track >= toc.last || t->offset + (lba - t->start) * t->sector_size + ofs < 0) {
+    memset(buf, 0, len);
+    return 0;
+  }
+  pos = t->offset + (lba - t->start) * t->sector_size + ofs;
+  fp = cue_gettrackfile(track);
+  if (f_tell(fp) != pos && IDXSeekPos(toc.file, pos) != FR_OK) {
+    memset(buf, 0, len);
+    return 0;
+  }
+  f_read(fp, buf, len, &br);
+  if (br < len) memset(buf + br, 0, len - br);
+  return br;
+}
+
+#if CUE_READAHEAD_SECTORS
+// read up to max sectors following the buffered ones into the ring, with
+// one contiguous read (two when the ring wraps around). With max 0 the
+// count adapts: one sector after a seek, doubled for every read which
+// continues the stream. Sectors before lba are dropped, buffering starts
+// over at lba if it doesn't continue the buffered run. Returns the number
+// of sectors read.
+int cue_readahead(int lba, int max) {
+  int track = cue_gettrackbylba(lba);
+  cd_track_t *t = &toc.tracks[track];
+  int next, slot, n, run;
+  FSIZE_t pos;
+  FIL *fp;
+  UINT br;
+
+  if (track >= toc.last || t->offset + (lba - t->start) * t->sector_size < 0)
+    return 0; // not in the image
+
+  if (track != ra_track || lba < ra_first || lba > ra_first + ra_count) {
+    ra_track = track;
+    ra_first = lba;
+    ra_head = 0;
+    ra_count = 0;
+    ra_slots = sizeof(ra_buf) / t->sector_size;
+    ra_depth = 1;
+  } else {
+    if (lba > ra_first) {
+      ra_head = (ra_head + lba - ra_first) % ra_slots;
+      ra_count -= lba - ra_first;
+      ra_first = lba;
+      if (!ra_count) ra_head = 0; // keep the next read contiguous
+    }
+    if (!max && ra_depth < ra_slots) ra_depth <<= 1;
+  }
+
+  next = ra_first + ra_count;
+  n = ra_slots - ra_count;
+  if (!max) max = ra_depth;
+  if (n > max) n = max;
+  if (n > t->end - next) n = t->end - next;
+  if (n <= 0) return 0;
+
+  pos = t->offset + (next - t->start) * t->sector_size;
+  fp = cue_gettrackfile(track);
+  if (f_tell(fp) != pos && IDXSeekPos(toc.file, pos) != FR_OK) return 0;
+
+  slot = (ra_head + ra_count) % ra_slots;
+  for (int left = n; left; left -= run, slot = 0) {
+    run = ra_slots - slot;
+    if (run > left) run = left;
+    br = 0;
+    f_read(fp, ra_buf + slot * t->sector_size, run * t->sector_size, &br);
+    if (br < run * t->sector_size)
+      memset(ra_buf + slot * t->sector_size + br, 0, run * t->sector_size - br);
+  }
+  ra_count += n;
+  return n;
+}
+
+// number of sectors buffered from lba on
+int cue_readahead_count(int lba) {
+  if (cue_gettrackbylba(lba) != ra_track || lba < ra_first || lba >= ra_first + ra_count)
+    return 0;
+  return ra_first + ra_count - lba;
+}
+
+// cue_readsector() through the read-ahead ring, for sequential streams.
+// A sector which is not buffered yet refills the ring starting with it.
+UINT cue_readsector_ra(int lba, int ofs, unsigned char *buf, UINT len) {
+  int track = cue_gettrackbylba(lba);
+
+  if (track < toc.last && ofs + len <= toc.tracks[track].sector_size) {
+    if (track != ra_track || lba < ra_first || lba >= ra_first + ra_count)
+      cue_readahead(lba, 0);
+    if (track == ra_track && lba >= ra_first && lba < ra_first + ra_count) {
+      memcpy(buf, ra_buf + ((ra_head + lba - ra_first) % ra_slots) * toc.tracks[track].sector_size + ofs, len);
+      return len;
+    }
+  }
+  return cue_readsector(lba, ofs, buf, len);
+}
+#endif
+#endif
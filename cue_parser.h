@@ -16,15 +16,37 @@
 #define CUE_RES_UNS      3
 #define CUE_RES_BINERR   4
 
+// max. number of .bin files (one per track on split images)
+#ifndef CUE_MAX_FILES
+#define CUE_MAX_FILES    24
+#endif
+
+// raw sectors buffered for streaming reads (0 - no read-ahead)
+#ifndef CUE_READAHEAD_SECTORS
+#define CUE_READAHEAD_SECTORS 0
+#endif
+
 typedef struct
 {
-        int offset;
+        int offset;       // in the track's .bin file
         int start;
         int end;
-        int type;
-        int sector_size;
+        short sector_size;
+        unsigned char type;
+        unsigned char file; // index of the track's .bin file
 } cd_track_t;
 
+#ifndef CUE_PARSER_TEST
+typedef struct
+{
+        FFOBJID obj;      // object id of the opened file
+        DWORD *cltbl;     // its part of the cluster link map
+        DWORD *ckpt;      // or its checkpoints, if the link map didn't fit
+        WORD ckpts;
+        BYTE ckshift;
+} cd_file_t;
+#endif
+
 typedef struct
 {
         int valid;
@@ -32,7 +54,11 @@ typedef struct
         int last;
         cd_track_t tracks[100];
 #ifndef CUE_PARSER_TEST
-        IDXFile *file; // the .bin file
+        IDXFile *file; // the .bin file, switched between the files below
+        FSIZE_t size;  // total size of the .bin files
+        int files;
+        int curfile;
+        cd_file_t bin[CUE_MAX_FILES];
 #endif
 } toc_t;
 
@@ -54,6 +80,19 @@ char cue_parse(const char *filename, IDXFile *image);
 void LBA2MSF(int lba, msf_t* msf);
 int MSF2LBA(unsigned char m, unsigned char s, unsigned char f);
 int cue_gettrackbylba(int lba);
+#ifndef CUE_PARSER_TEST
+FIL *cue_gettrackfile(int track);
+UINT cue_readsector(int lba, int ofs, unsigned char *buf, UINT len);
+#if CUE_READAHEAD_SECTORS
+int cue_readahead(int lba, int max);
+int cue_readahead_count(int lba);
+UINT cue_readsector_ra(int lba, int ofs, unsigned char *buf, UINT len);
+#else
+#define cue_readahead(lba, max) ((void)(lba), 0)
+#define cue_readahead_count(lba) 0
+#define cue_readsector_ra cue_readsector
+#endif
+#endif
 
 #endif // __CUE_PARSER_H__
 
@@ -10,11 +10,9 @@
 //#define CUEFILE "Sherlock Holmes Consulting Detective (USA).cue"
 #define CUEFILE "Space Ava 201.cue"
 
-void iprintf(const char *format, ...) {
-    va_list arg;
-    va_start(arg, format);
-    vprintf(format, arg);
-    va_end(arg);
+const char *GetExtension(const char *fileName) {
+    const char *ext = strrchr(fileName, '.');
+    return ext ? ext + 1 : 0;
 }
 
 void cue_parser_debugf(char *str, const char *format, ...) {
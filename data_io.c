@@ -101,6 +101,12 @@ void data_io_file_tx_prepare(FIL *file, char index, const char *ext) {
 static void data_io_file_tx_send(FIL *file) {
   FSIZE_t bytes2send = f_size(file);
   UINT br;
+#ifdef HAVE_QSPI
+  char qspi = user_io_get_core_features() & FEAT_QSPI;
+  char *buf = sector_buffer;
+#endif
+  static const unsigned char pacing[] = SPI_DIO_PACING;
+  unsigned char dma = (user_io_get_core_features() & FEAT_DIO_DMA) >> FEAT_DIO_DMA_SHIFT;
 
   /* transmit the entire file using one transfer */
   iprintf("Selected %llu bytes to send\n", bytes2send);
@@ -119,30 +125,41 @@ static void data_io_file_tx_send(FIL *file) {
       f_read(file, 0, bytes2send, &br);
       DISKLED_OFF
       bytes2send = 0;
+#ifdef HAVE_QSPI
+    } else if (qspi) {
+      // read into one half of the buffer while the other half is still
+      // being sent by the DMA
+      if (chunk > SECTOR_BUFFER_SIZE/2) chunk = SECTOR_BUFFER_SIZE/2;
+      DISKLED_ON
+      f_read(file, buf, chunk, &br);
+      DISKLED_OFF
+      qspi_write_block_start(buf, chunk);
+      buf = (buf == sector_buffer) ? sector_buffer + SECTOR_BUFFER_SIZE/2 : sector_buffer;
+      bytes2send -= chunk;
+#endif
     } else {
       DISKLED_ON
       f_read(file, sector_buffer, chunk, &br);
       DISKLED_OFF
 
-#ifdef HAVE_QSPI
-      if (user_io_get_core_features() & FEAT_QSPI) {
-        qspi_write_block(sector_buffer, chunk);
-      } else {
-#endif
-        EnableFpga();
-        SPI(DIO_FILE_TX_DAT);
+      EnableFpga();
+      SPI(DIO_FILE_TX_DAT);
 
-//      spi_write(sector_buffer, chunk); // DMA -- too fast for some cores
+      // plain DMA is too fast for some cores, only use it (paced) if the
+      // core asks for it
+      if (dma)
+        spi_write_paced(sector_buffer, chunk, pacing[dma]);
+      else
         for(p = sector_buffer, c=0;c < chunk;c++)
           SPI(*p++);
 
-        DisableFpga();
-#ifdef HAVE_QSPI
-      }
-#endif
+      DisableFpga();
       bytes2send -= chunk;
     }
   }
+#ifdef HAVE_QSPI
+  if (qspi) qspi_write_block_wait();
+#endif
 }
 
 
@@ -2,6 +2,8 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
 #include "mmc.h"
 #include "fat_compat.h"
 #include "fpga.h"
@@ -12,7 +14,7 @@
 #include "FatFs/ff.h"
 #include "FatFs/diskio.h"
 
-unsigned char sector_buffer[SECTOR_BUFFER_SIZE]; // sector buffer for one CDDA sector (or 4 SD sector)
+unsigned char sector_buffer[SECTOR_BUFFER_SIZE] __attribute__ ((aligned(4))); // sector buffer for one CDDA sector (or 4 SD sector)
 struct PartitionEntry partitions[4];             // lbastart and sectors will be byteswapped as necessary
 int partitioncount;
 
@@ -265,22 +267,27 @@ static DIR           dir;
 static FILINFO       fil;
 static unsigned char nNewEntries = 0;      // indicates if a new entry has been found (used in scroll mode)
 
-FAST static int CompareDirEntries(FILINFO *pDirEntry1, FILINFO *pDirEntry2)
+FAST static int CompareNames(BYTE attr1, const char *name1, BYTE attr2, const char *name2)
 {
 	int rc;
 
-	if ((pDirEntry2->fattrib & AM_DIR)  && !(pDirEntry1->fattrib & AM_DIR) // directories first
-	|| (pDirEntry2->fname[0] == '.' && pDirEntry2->fname[1] == '.')) // parent directory entry at top
+	if ((attr2 & AM_DIR)  && !(attr1 & AM_DIR) // directories first
+	|| (name2[0] == '.' && name2[1] == '.')) // parent directory entry at top
 		return 1;
 
-	if ((pDirEntry1->fattrib & AM_DIR) && !(pDirEntry2->fattrib & AM_DIR) // directories first
-	|| (pDirEntry1->fname[0] == '.' && pDirEntry1->fname[1] == '.')) // parent directory entry at top
+	if ((attr1 & AM_DIR) && !(attr2 & AM_DIR) // directories first
+	|| (name1[0] == '.' && name1[1] == '.')) // parent directory entry at top
 		return -1;
 
-	rc = _strnicmp(pDirEntry1->fname, pDirEntry2->fname, FF_LFN_BUF+1);
+	rc = _strnicmp(name1, name2, FF_LFN_BUF+1);
 	return(rc);
 }
 
+FAST static int CompareDirEntries(FILINFO *pDirEntry1, FILINFO *pDirEntry2)
+{
+	return CompareNames(pDirEntry1->fattrib, pDirEntry1->fname, pDirEntry2->fattrib, pDirEntry2->fname);
+}
+
 FAST static char CompareExt(const char *fileName, const char *extension)
 {
 	char found = 0;
@@ -331,6 +338,159 @@ FAST static void SortTempTable(char prev) {
 	}
 }
 
+FAST static char MatchEntry(FILINFO *pEntry, char *extension, unsigned char options) {
+	return !(pEntry->fattrib & AM_HID) &&
+	       ((extension[0] == '*')
+	        || CompareExt(pEntry->fname, extension)
+	        || (options & SCAN_DIR && pEntry->fattrib & AM_DIR)
+	        || (options & SCAN_SYSDIR && pEntry->fattrib & AM_DIR && (pEntry->fattrib & AM_SYS || (pEntry->fname[0] == '.' && pEntry->fname[1] == '.'))));
+}
+
+#if DIR_CACHE_SIZE
+// Directory cache: the matching entries of the current directory are read
+// once into the cache, and sorted by an index of their positions, so the
+// browser pages through them without scanning the directory again.
+// Directories not fitting into the cache are scanned as before.
+typedef struct {
+	FSIZE_t fsize;
+	DWORD   fclust;
+	BYTE    fattrib;
+	char    fname[3]; // zero terminated, continues into the following units
+} dcache_entry_t;
+
+#define DCACHE_UNITS    (DIR_CACHE_SIZE / sizeof(dcache_entry_t))
+#define DCACHE_ENTRY(n) ((dcache_entry_t*)&dcache[dcache_index[n]])
+
+static dcache_entry_t dcache[DCACHE_UNITS]; // entries from the start, index from the end
+static WORD          *dcache_index;         // sorted positions of the entries
+static unsigned int   dcache_used;          // units used by the entries
+static unsigned int   dcache_count;
+static unsigned int   dcache_top;           // first displayed entry
+static char           dcache_valid;
+static WORD           dcache_fsid;
+static DWORD          dcache_cdir;
+
+static int DirCacheCompare(const void *a, const void *b) {
+	dcache_entry_t *e1 = &dcache[*(const WORD*)a];
+	dcache_entry_t *e2 = &dcache[*(const WORD*)b];
+	return CompareNames(e1->fattrib, e1->fname, e2->fattrib, e2->fname);
+}
+
+static char DirCacheAdd(FILINFO *pEntry) {
+	unsigned int len = strlen(pEntry->fname);
+	unsigned int units = (offsetof(dcache_entry_t, fname) + len + 1 + sizeof(dcache_entry_t) - 1) / sizeof(dcache_entry_t);
+	dcache_entry_t *e = &dcache[dcache_used];
+
+	if ((dcache_used + units) * sizeof(dcache_entry_t) + (dcache_count + 1) * sizeof(WORD) > sizeof(dcache))
+		return 0;
+
+	e->fsize = pEntry->fsize;
+	e->fclust = pEntry->fclust;
+	e->fattrib = pEntry->fattrib;
+	memcpy(e->fname, pEntry->fname, len + 1);
+	dcache_count++;
+	dcache_index = (WORD*)((char*)dcache + sizeof(dcache)) - dcache_count;
+	dcache_index[0] = dcache_used;
+	dcache_used += units;
+	return 1;
+}
+
+// read the already opened directory into the cache
+static void DirCacheLoad(char *extension, unsigned char options) {
+	char initial = 1;
+
+	dcache_valid = 0;
+	dcache_used = dcache_count = dcache_top = 0;
+	disk_cache_set(true, fs.database);
+	while (1) {
+		if (initial && fs.cdir && options & (SCAN_DIR | SCAN_SYSDIR)) {
+			memset(&fil, 0, sizeof(fil));
+			fil.fattrib = AM_DIR;
+			strcpy(fil.fname, "..");
+			initial = 0;
+		} else {
+			if (f_readdir(&dir, &fil) != FR_OK) break;
+		}
+		if (fil.fname[0] == 0) break;
+
+		if (MatchEntry(&fil, extension, options) && !DirCacheAdd(&fil)) {
+			disk_cache_set(false, 0);
+			iprintf("Directory doesn't fit into the cache\n");
+			return;
+		}
+	}
+	disk_cache_set(false, 0);
+
+	if (dcache_count) qsort(dcache_index, dcache_count, sizeof(WORD), DirCacheCompare);
+	dcache_fsid = fs.id;
+	dcache_cdir = fs.cdir;
+	dcache_valid = 1;
+}
+
+static char DirCacheScan(unsigned long mode, char find_file, char find_dir) {
+	dcache_entry_t *e;
+	char rc = 0;
+	unsigned int i;
+	unsigned char x;
+
+	if (mode == SCAN_INIT) {
+		dcache_top = 0;
+	} else if (mode == SCAN_INIT_FIRST) {
+		// find the entry with given cluster number, and display the following ones
+		for (i = 0; i < dcache_count && DCACHE_ENTRY(i)->fclust != iPreviousDirectory; i++);
+		if (i == dcache_count) return 0;
+		dcache_top = i;
+		rc = 1;
+	} else if (mode == SCAN_NEXT) {
+		if (dcache_top + maxDirEntries < dcache_count) dcache_top++;
+	} else if (mode == SCAN_PREV) {
+		if (dcache_top) dcache_top--;
+	} else if (mode == SCAN_NEXT_PAGE) {
+		if (dcache_top + maxDirEntries < dcache_count) {
+			dcache_top += maxDirEntries;
+			if (dcache_top + maxDirEntries > dcache_count) dcache_top = dcache_count - maxDirEntries;
+		}
+	} else if (mode == SCAN_PREV_PAGE) {
+		dcache_top = dcache_top > maxDirEntries ? dcache_top - maxDirEntries : 0;
+	} else if ((mode >= '0' && mode <= '9') || (mode >= 'A' && mode <= 'Z')) {// find first entry beginning with given character
+		for (i = (find_file || find_dir) ? 0 : dcache_top + iSelectedEntry + 1; i < dcache_count; i++) {
+			e = DCACHE_ENTRY(i);
+			if (find_file)
+				x = tolower(e->fname[0]) >= tolower(mode) && !(e->fattrib & AM_DIR);
+			else if (find_dir)
+				x = tolower(e->fname[0]) >= tolower(mode) || !(e->fattrib & AM_DIR);
+			else
+				x = 1; // entries are sorted, so the next one follows the selected
+			if (x) break;
+		}
+		if (i == dcache_count || tolower(DCACHE_ENTRY(i)->fname[0]) != tolower(mode)) return 0;
+		e = DCACHE_ENTRY(i);
+		x = 1;
+		if (find_dir)
+			x = e->fattrib & AM_DIR;
+		else if (!find_file)
+			x = (e->fattrib & AM_DIR) == (DirEntries[sort_table[iSelectedEntry]].fattrib & AM_DIR);
+		if (!x) return 0;
+		dcache_top = i;
+		iSelectedEntry = 0;
+		rc = 1;
+	}
+
+	// copy the displayed entries
+	for (i = 0; i < maxDirEntries; i++)
+		sort_table[i] = i;
+	for (nDirEntries = 0; nDirEntries < maxDirEntries && dcache_top + nDirEntries < dcache_count; nDirEntries++) {
+		e = DCACHE_ENTRY(dcache_top + nDirEntries);
+		DirEntries[nDirEntries].fsize = e->fsize;
+		DirEntries[nDirEntries].fclust = e->fclust;
+		DirEntries[nDirEntries].fattrib = e->fattrib;
+		DirEntries[nDirEntries].altname[0] = 0;
+		strcpy(DirEntries[nDirEntries].fname, e->fname);
+	}
+	return rc;
+}
+#endif
+
 //mode: SCAN_INIT, SCAN_PREV, SCAN_NEXT, SCAN_PREV_PAGE, SCAN_NEXT_PAGE
 char ScanDirectory(unsigned long mode, char *extension, unsigned char options) {
 
@@ -398,6 +558,13 @@ char ScanDirectory(unsigned long mode, char *extension, unsigned char options) {
 		find_dir = options & FIND_DIR;
 	}
 
+#if DIR_CACHE_SIZE
+	if (mode == SCAN_INIT || mode == SCAN_INIT_FIRST)
+		DirCacheLoad(extension, options);
+	if (dcache_valid && dcache_fsid == fs.id && dcache_cdir == fs.cdir)
+		return DirCacheScan(mode, find_file, find_dir);
+#endif
+
 	//enable caching in the sector buffer while traversing the directory,
 	//because FatFs is inefficiently using single sector reads
 	disk_cache_set(true, fs.database);
@@ -416,11 +583,7 @@ char ScanDirectory(unsigned long mode, char *extension, unsigned char options) {
 
 		is_file = ~fil.fattrib & AM_DIR;
 
-		if (!(fil.fattrib & AM_HID) &&
-		   ((extension[0] == '*')
-                    || CompareExt(fil.fname, extension)
-                    || (options & SCAN_DIR && fil.fattrib & AM_DIR)
-                    || (options & SCAN_SYSDIR && fil.fattrib & AM_DIR && (fil.fattrib & AM_SYS || (fil.fname[0] == '.' && fil.fname[1] == '.')))))
+		if (MatchEntry(&fil, extension, options))
 		{
 			if (mode == SCAN_INIT) { // initial directory scan (first 8 entries)
 				if (nDirEntries < maxDirEntries) {
@@ -24,6 +24,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // 2010-01-09   - support for variable number of tracks
 
 #include <stdio.h>
+#include <string.h>
 
 #include "errors.h"
 #include "hardware.h"
@@ -48,124 +49,244 @@ adfTYPE df[4];            // drive 0 information structure
 #define LAST_SECTOR (SECTOR_COUNT - 1)
 #define GAP_SIZE (TRACK_SIZE - SECTOR_COUNT * SECTOR_SIZE)
 
-// sends the data in the sector buffer to the FPGA, translated into an Amiga floppy format sector
-// note that we do not insert clock bits because they will be stripped by the Amiga software anyway
-void SendSector(unsigned char *pData, unsigned char sector, unsigned char track, unsigned char dsksynch, unsigned char dsksyncl)
+#define FLUSH_DELAY 1000 // ms after the last sector write until dirty tracks are written back
+
+// calculates the data field checksum of a sector
+static void SectorChecksum(unsigned char *pData, unsigned char *checksum)
 {
-    unsigned char checksum[4];
     unsigned short i;
     unsigned char x;
-    unsigned char *p;
-
-    // preamble
-    SPI(0xAA);
-    SPI(0xAA);
-    SPI(0xAA);
-    SPI(0xAA);
-
-    // synchronization
-    SPI(dsksynch);
-    SPI(dsksyncl);
-    SPI(dsksynch);
-    SPI(dsksyncl);
-
-    // odd bits of header
-    x = 0x55;
-    checksum[0] = x;
-    SPI(x);
-    x = track >> 1 & 0x55;
-    checksum[1] = x;
-    SPI(x);
-    x = sector >> 1 & 0x55;
-    checksum[2] = x;
-    SPI(x);
-    x = 11 - sector >> 1 & 0x55;
-    checksum[3] = x;
-    SPI(x);
 
-    // even bits of header
-    x = 0x55;
-    checksum[0] ^= x;
-    SPI(x);
-    x = track & 0x55;
-    checksum[1] ^= x;
-    SPI(x);
-    x = sector & 0x55;
-    checksum[2] ^= x;
-    SPI(x);
-    x = 11 - sector & 0x55;
-    checksum[3] ^= x;
-    SPI(x);
-
-    // sector label and reserved area (changes nothing to checksum)
-    i = 0x20;
-    while (i--)
-        SPI(0xAA);
-
-    // send header checksum
-    SPI(0xAA);
-    SPI(0xAA);
-    SPI(0xAA);
-    SPI(0xAA);
-    SPI(checksum[0] | 0xAA);
-    SPI(checksum[1] | 0xAA);
-    SPI(checksum[2] | 0xAA);
-    SPI(checksum[3] | 0xAA);
-
-    // calculate data checksum
     checksum[0] = 0;
     checksum[1] = 0;
     checksum[2] = 0;
     checksum[3] = 0;
 
-    p = pData;
     i = DATA_SIZE / 2 / 4;
     while (i--)
     {
-        x = *p++;
+        x = *pData++;
         checksum[0] ^= x ^ x >> 1;
-        x = *p++;
+        x = *pData++;
         checksum[1] ^= x ^ x >> 1;
-        x = *p++;
+        x = *pData++;
         checksum[2] ^= x ^ x >> 1;
-        x = *p++;
+        x = *pData++;
         checksum[3] ^= x ^ x >> 1;
     }
+}
 
-    // send data checksum
-    SPI(0xAA);
-    SPI(0xAA);
-    SPI(0xAA);
-    SPI(0xAA);
-    SPI(checksum[0] | 0xAA);
-    SPI(checksum[1] | 0xAA);
-    SPI(checksum[2] | 0xAA);
-    SPI(checksum[3] | 0xAA);
-
-    // odd bits of data field
-    i = DATA_SIZE / 2;
-    p = pData;
-    while (i--)
-        SPI(*p++ >> 1 | 0xAA);
+#if FDD_TRACK_CACHE
+// whole tracks read from the disk images, shared by all drives
+typedef struct
+{
+    DWORD          sclust;                      // start cluster of the image
+    unsigned char  checksum[SECTOR_COUNT][4];   // data field checksums
+    unsigned char  data[SECTOR_COUNT * 512];    // word aligned for the MFM decoder
+    unsigned char  track;
+    unsigned char  valid;                       // sclust and track hold a read track
+    unsigned short dirty;                       // sectors not yet written to the image
+    adfTYPE       *drive;                       // drive the dirty sectors were written on
+} fddTrackTYPE;
+
+static fddTrackTYPE track_cache[FDD_TRACK_CACHE];
+static unsigned char track_cache_next;
+static unsigned long flush_timer;
+
+// writes the dirty sectors of a cached track to the image in one block
+static void FlushTrack(fddTrackTYPE *pTrack)
+{
+    unsigned char first, last;
+    FRESULT res;
+    UINT bw;
 
-    // even bits of data field
-    i = DATA_SIZE / 2;
-    p = pData;
-    while (i--)
-        SPI(*p++ | 0xAA);
+    if (!pTrack->dirty)
+        return;
+
+    // the image may have been replaced in the meantime
+    if (pTrack->drive->file.obj.sclust == pTrack->sclust)
+    {
+        for (first = 0; !(pTrack->dirty & (1 << first)); first++);
+        for (last = LAST_SECTOR; !(pTrack->dirty & (1 << last)); last--);
+
+        fdd_debugf("Flush track %d sectors %d-%d\r", pTrack->track, first, last);
+        res = f_lseek(&pTrack->drive->file, (pTrack->track * SECTOR_COUNT + first) * 512);
+        if (!res)
+            res = f_write(&pTrack->drive->file, &pTrack->data[first * 512], (last - first + 1) * 512, &bw);
+        if (!res)
+            res = f_sync(&pTrack->drive->file);
+        if (res)
+        {
+            fdd_debugf("FlushTrack: error %u\r", res);
+            ErrorMessage("  WriteTrack", res);
+        }
+    }
+    pTrack->dirty = 0;
+}
+
+// returns the cached track of the drive, reading it from the disk image if needed
+static fddTrackTYPE *GetTrack(adfTYPE *drive)
+{
+    fddTrackTYPE *t = 0;
+    unsigned char sector;
+    unsigned char i;
+    UINT br = 0;
+
+    for (i = 0; i < FDD_TRACK_CACHE; i++)
+    {
+        if (!track_cache[i].valid || track_cache[i].sclust != drive->file.obj.sclust)
+            continue;
+        if (track_cache[i].track == drive->track)
+            t = &track_cache[i];
+        else // the head has left this track
+            FlushTrack(&track_cache[i]);
+    }
+    if (t)
+        return t;
+
+    t = &track_cache[track_cache_next];
+    if (++track_cache_next == FDD_TRACK_CACHE)
+        track_cache_next = 0;
+    FlushTrack(t);
+
+    // all sectors of the track in one multi-sector read
+    f_lseek(&drive->file, drive->track * SECTOR_COUNT * 512);
+    if (f_read(&drive->file, t->data, SECTOR_COUNT * 512, &br) != FR_OK)
+        br = 0;
+    if (br < SECTOR_COUNT * 512)
+        memset(t->data + br, 0, SECTOR_COUNT * 512 - br);
+
+    // data checksums, they only change when the track is written
+    for (sector = 0; sector < SECTOR_COUNT; sector++)
+        SectorChecksum(&t->data[sector * 512], t->checksum[sector]);
+
+    t->sclust = drive->file.obj.sclust;
+    t->track = drive->track;
+    t->valid = 1;
+    return t;
+}
+
+#else
+// without a track cache each sector is read from the image into the sector
+// buffer, behind the MFM sector built from it
+#define SECTOR_DATA (sector_buffer + SECTOR_SIZE)
+#endif
+
+// writes all dirty tracks to their images
+void FlushTracks(void)
+{
+#if FDD_TRACK_CACHE
+    unsigned char i;
+
+    for (i = 0; i < FDD_TRACK_CACHE; i++)
+        FlushTrack(&track_cache[i]);
+#endif
+}
+
+// writes back and drops all cached tracks, a newly inserted image may reuse the clusters of an old one
+void FlushTrackCache(void)
+{
+#if FDD_TRACK_CACHE
+    unsigned char i;
+
+    for (i = 0; i < FDD_TRACK_CACHE; i++)
+    {
+        FlushTrack(&track_cache[i]);
+        track_cache[i].valid = 0;
+    }
+#endif
+}
+
+// sends a sector to the FPGA, translated into an Amiga floppy format sector
+// the sector is built in the sector buffer and sent in one block
+// note that we do not insert clock bits because they will be stripped by the Amiga software anyway
+static void SendSector(unsigned char *pData, unsigned char *checksum, unsigned char sector, unsigned char track, unsigned char dsksynch, unsigned char dsksyncl)
+{
+    unsigned char *p = sector_buffer;
+    unsigned char *h;
+    unsigned short i;
+    unsigned char x;
+
+    // preamble
+    *p++ = 0xAA;
+    *p++ = 0xAA;
+    *p++ = 0xAA;
+    *p++ = 0xAA;
+
+    // synchronization
+    *p++ = dsksynch;
+    *p++ = dsksyncl;
+    *p++ = dsksynch;
+    *p++ = dsksyncl;
+
+    // odd bits of header
+    h = p;
+    *p++ = 0x55;
+    *p++ = track >> 1 & 0x55;
+    *p++ = sector >> 1 & 0x55;
+    *p++ = 11 - sector >> 1 & 0x55;
+
+    // even bits of header
+    *p++ = 0x55;
+    *p++ = track & 0x55;
+    *p++ = sector & 0x55;
+    *p++ = 11 - sector & 0x55;
+
+    // sector label and reserved area (changes nothing to checksum)
+    memset(p, 0xAA, 0x20);
+    p += 0x20;
+
+    // header checksum
+    *p++ = 0xAA;
+    *p++ = 0xAA;
+    *p++ = 0xAA;
+    *p++ = 0xAA;
+    *p++ = (h[0] ^ h[4]) | 0xAA;
+    *p++ = (h[1] ^ h[5]) | 0xAA;
+    *p++ = (h[2] ^ h[6]) | 0xAA;
+    *p++ = (h[3] ^ h[7]) | 0xAA;
+
+    // data checksum
+    *p++ = 0xAA;
+    *p++ = 0xAA;
+    *p++ = 0xAA;
+    *p++ = 0xAA;
+    *p++ = checksum[0] | 0xAA;
+    *p++ = checksum[1] | 0xAA;
+    *p++ = checksum[2] | 0xAA;
+    *p++ = checksum[3] | 0xAA;
+
+    // odd and even bits of data field
+    for (i = 0; i < DATA_SIZE / 2; i++)
+    {
+        x = pData[i];
+        p[i] = x >> 1 | 0xAA;
+        p[i + DATA_SIZE / 2] = x | 0xAA;
+    }
+
+    // The sector goes out at the full SPI rate like the minimig IDE sectors
+    // in hdd.c. On the SAM7S EnableFpgaMinimig is the plain FPGA select, on
+    // the SAMV71 it sets a delay between the bytes which paces every transfer
+    // on that chip select, the DMA ones included. The per-byte SPIN delay of
+    // the old code was an empty macro on both.
+    spi_write(sector_buffer, SECTOR_SIZE);
 }
 
 void SendGap(void)
 {
-    unsigned short i = GAP_SIZE;
-    while (i--)
-        SPI(0xAA);
+    memset(sector_buffer, 0xAA, GAP_SIZE);
+    spi_write(sector_buffer, GAP_SIZE);
 }
 
 // read a track from disk
 void ReadTrack(adfTYPE *drive)
 { // track number is updated in drive struct before calling this function
 
+#if FDD_TRACK_CACHE
+    fddTrackTYPE *pTrack;
+#else
+    unsigned char checksum[4];
+#endif
     unsigned char sector;
     unsigned char status;
     unsigned char track;
@@ -186,15 +307,19 @@ void ReadTrack(adfTYPE *drive)
         drive->track_prev = drive->track;
         sector = 0;
         drive->sector_offset = sector;
-        f_lseek(&drive->file, drive->track * SECTOR_COUNT * 512);
     }
     else
     { // same track, start at next sector in track
         sector = drive->sector_offset;
-        f_lseek(&drive->file, (drive->track * SECTOR_COUNT + sector) * 512);
     }
     fdd_debugf("sector: %d\r", sector);
 
+#if FDD_TRACK_CACHE
+    pTrack = GetTrack(drive);
+#else
+    f_lseek(&drive->file, (drive->track * SECTOR_COUNT + sector) * 512);
+#endif
+
     EnableFpgaMinimig();
     status   = SPI(0); // read request signal
     track    = SPI(0); // track number (cylinder & head)
@@ -209,7 +334,9 @@ void ReadTrack(adfTYPE *drive)
 
     while (1)
     {
-        FileReadBlock(&drive->file, sector_buffer);
+#if !FDD_TRACK_CACHE
+        FileReadBlock(&drive->file, SECTOR_DATA);
+#endif
 
         EnableFpgaMinimig();
 
@@ -244,7 +371,12 @@ void ReadTrack(adfTYPE *drive)
             {
                 //GenerateHeader(sector_header, sector_buffer, sector, track, dsksync);
                 //SendSector(sector_header, sector_buffer);
-                SendSector(sector_buffer, sector, track, (unsigned char)(dsksync >> 8), (unsigned char)dsksync);
+#if FDD_TRACK_CACHE
+                SendSector(&pTrack->data[sector * 512], pTrack->checksum[sector], sector, track, (unsigned char)(dsksync >> 8), (unsigned char)dsksync);
+#else
+                SectorChecksum(SECTOR_DATA, checksum);
+                SendSector(SECTOR_DATA, checksum, sector, track, (unsigned char)(dsksync >> 8), (unsigned char)dsksync);
+#endif
 
                 if (sector == LAST_SECTOR)
                     SendGap();
@@ -263,14 +395,12 @@ void ReadTrack(adfTYPE *drive)
             break;
 
         sector++;
-        if (sector < SECTOR_COUNT)
-        {
-            //FileNextSector(&file);
-        }
-        else // go to the start of current track
+        if (sector == SECTOR_COUNT) // go to the start of current track
         {
             sector = 0;
+#if !FDD_TRACK_CACHE
             f_lseek(&drive->file, (drive->track * SECTOR_COUNT) * 512);
+#endif
         }
 
         // remember current sector and cluster
@@ -471,13 +601,30 @@ unsigned char GetHeader(unsigned char *pTrack, unsigned char *pSector)
     return 0;
 }
 
-unsigned char GetData(void)
+// decodes an MFM data field (checksum, odd bits, even bits) a word at a time
+// returns 0 on a checksum error
+static unsigned char DecodeData(const DWORD *pMfm, unsigned char *pData)
 {
-    unsigned char c, c1, c2, c3, c4;
-    unsigned char i;
-    unsigned char *p;
+    const DWORD *odd = pMfm + 2;
+    const DWORD *even = pMfm + 2 + DATA_SIZE / 2 / 4;
+    DWORD *p = (DWORD*)pData;
+    DWORD checksum = 0;
+    unsigned short i;
+
+    for (i = 0; i < DATA_SIZE / 4; i++)
+        checksum ^= odd[i];
+    if ((checksum & 0x55555555) != (((pMfm[0] & 0x55555555) << 1) | (pMfm[1] & 0x55555555)))
+        return 0;
+
+    for (i = 0; i < DATA_SIZE / 2 / 4; i++)
+        p[i] = ((odd[i] & 0x55555555) << 1) | (even[i] & 0x55555555);
+    return 1;
+}
+
+unsigned char GetData(unsigned char *pData)
+{
+    unsigned char c1, c2, c3, c4;
     unsigned short n;
-    unsigned char checksum[4];
 
     Error = 0;
     while (1)
@@ -498,84 +645,16 @@ unsigned char GetData(void)
 
         if (n >= 0x204)
         {
-            SPIN;
-
-            c1 = ((SPI(0)) & 0x55) << 1;
-            c2 = ((SPI(0)) & 0x55) << 1;
-            SPIN;
-            c3 = ((SPI(0)) & 0x55) << 1;
-            c4 = ((SPI(0)) & 0x55) << 1;
-
-            SPIN;
-
-            c1 |= (SPI(0)) & 0x55;
-            c2 |= (SPI(0)) & 0x55;
-            SPIN;
-            c3 |= (SPI(0)) & 0x55;
-            c4 |= (SPI(0)) & 0x55;
-
-            checksum[0] = 0;
-            checksum[1] = 0;
-            checksum[2] = 0;
-            checksum[3] = 0;
-
-            // odd bits of data field
-            i = 128;
-            p = sector_buffer;
-            do
-            {
-                SPIN;
-                c = SPI(0);
-                checksum[0] ^= c;
-                *p++ = (c & 0x55) << 1;
-                c = SPI(0);
-                checksum[1] ^= c;
-                *p++ = (c & 0x55) << 1;
-                SPIN;
-                c = SPI(0);
-                checksum[2] ^= c;
-                *p++ = (c & 0x55) << 1;
-                c = SPI(0);
-                checksum[3] ^= c;
-                *p++ = (c & 0x55) << 1;
-            }
-            while (--i);
-
-            // even bits of data field
-            i = 128;
-            p = sector_buffer;
-            do
-            {
-                SPIN;
-                c = SPI(0);
-                checksum[0] ^= c;
-                *p++ |= c & 0x55;
-                c = SPI(0);
-                checksum[1] ^= c;
-                *p++ |= c & 0x55;
-                SPIN;
-                c = SPI(0);
-                checksum[2] ^= c;
-                *p++ |= c & 0x55;
-                c = SPI(0);
-                checksum[3] ^= c;
-                *p++ |= c & 0x55;
-            }
-            while (--i);
-
-            checksum[0] &= 0x55;
-            checksum[1] &= 0x55;
-            checksum[2] &= 0x55;
-            checksum[3] &= 0x55;
+            // the whole data field (checksum and data) is in the fifo, read it in one block
+            spi_read((char*)sector_buffer, 8 + DATA_SIZE);
+            DisableFpga();
 
-            if (c1 != checksum[0] || c2 != checksum[1] || c3 != checksum[2] || c4 != checksum[3])
+            if (!DecodeData((DWORD*)sector_buffer, pData))
             {
                 fdd_debugf("Checksum error\r");
                 Error = 29;
-                break;
+                return 0;
             }
-
-            DisableFpga();
             return 1;
         }
         else if ((c3 & 0x80) == 0) // not enough data in fifo and write dma is not active
@@ -593,39 +672,56 @@ unsigned char GetData(void)
 
 void WriteTrack(adfTYPE *drive)
 {
+#if FDD_TRACK_CACHE
+    fddTrackTYPE *pTrack;
+#else
+    FRESULT res;
+#endif
     unsigned char Track;
     unsigned char Sector;
-    FRESULT res;
-    FSIZE_t fpos;
 
     fdd_debugf("Write track %d\r", drive->track);
     drive->track_prev = -1; // just to force next read from the start of current track
 
+#if FDD_TRACK_CACHE
+    // sectors are collected in the track cache and written to the image
+    // when the head leaves the track or after FLUSH_DELAY
+    pTrack = GetTrack(drive);
+#endif
+
     while (FindSync(drive))
     {
         if (GetHeader(&Track, &Sector))
         {
             if (Track == drive->track)
             {
-                res = f_lseek(&drive->file, (drive->track * SECTOR_COUNT + Sector) * 512);
-                fpos = f_tell(&drive->file);
-                if (res || (fpos != (drive->track * SECTOR_COUNT + Sector) * 512)) {
-                    Error = res;
+                if (!(drive->status & DSK_WRITABLE))
+                {
+                    // still take the data out of the fifo
+                    GetData(sector_buffer + 8 + DATA_SIZE);
+                    Error = 30;
+                    fdd_debugf("Write attempt to protected disk!\r");
                 }
-                else if (GetData())
+#if FDD_TRACK_CACHE
+                else if (GetData(&pTrack->data[Sector * 512]))
                 {
-                    if (drive->status & DSK_WRITABLE)
-                    {
-                        fdd_debugf("Write sector: %d\r", Sector);
-                        res = FileWriteBlock(&drive->file, sector_buffer);
-                        if (res) Error = res;
-                    }
-                    else
-                    {
-                        Error = 30;
-                        fdd_debugf("Write attempt to protected disk!\r");
-                    }
+                    fdd_debugf("Write sector: %d\r", Sector);
+                    SectorChecksum(&pTrack->data[Sector * 512], pTrack->checksum[Sector]);
+                    pTrack->dirty |= 1 << Sector;
+                    pTrack->drive = drive;
+                    flush_timer = GetTimer(FLUSH_DELAY);
                 }
+#else
+                else if (GetData(SECTOR_DATA))
+                {
+                    fdd_debugf("Write sector: %d\r", Sector);
+                    res = f_lseek(&drive->file, (drive->track * SECTOR_COUNT + Sector) * 512);
+                    if (!res)
+                        res = FileWriteBlock(&drive->file, SECTOR_DATA);
+                    if (res)
+                        Error = res;
+                }
+#endif
             }
             else
                 Error = 27; //track number reported in sector header is not the same as current drive track
@@ -636,7 +732,9 @@ void WriteTrack(adfTYPE *drive)
             ErrorMessage("  WriteTrack", Error);
         }
     }
+#if !FDD_TRACK_CACHE
     f_sync(&drive->file);
+#endif
 }
 
 void UpdateDriveStatus(void)
@@ -668,5 +766,14 @@ void HandleFDD(unsigned char c1, unsigned char c2)
         WriteTrack(&df[sel]);
         DISKLED_OFF;
     }
+
+#if FDD_TRACK_CACHE
+    // checked on every call, the Amiga keeps reading tracks while the motor is on
+    if (flush_timer && CheckTimer(flush_timer))
+    {
+        flush_timer = 0;
+        FlushTracks();
+    }
+#endif
 }
 
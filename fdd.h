@@ -27,10 +27,12 @@ typedef struct
 void SectorGapToFpga(void);
 void SectorHeaderToFpga(unsigned char n, unsigned char dsksynch, unsigned char dsksyncl);
 //unsigned short SectorToFpga(unsigned char sector, unsigned char track, unsigned char dsksynch, unsigned char dsksyncl);
+void FlushTracks(void);
+void FlushTrackCache(void);
 void ReadTrack(adfTYPE *drive);
 unsigned char FindSync(adfTYPE *drive);
 unsigned char GetHeader(unsigned char *pTrack, unsigned char *pSector);
-unsigned char GetData(void);
+unsigned char GetData(unsigned char *pData);
 void WriteTrack(adfTYPE *drive);
 void UpdateDriveStatus(void);
 void HandleFDD(unsigned char c1, unsigned char c2);
@@ -25,6 +25,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "barriers.h"
 #include "fat_compat.h"
 #include "firmware.h"
+#include "crc32.h"
 
 #ifndef FW_ID
 #define FW_ID "MNMGUPG"
@@ -32,21 +33,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 static DWORD clmt[99];
 
-unsigned long CalculateCRC32(unsigned long crc, unsigned char *pBuffer, unsigned long nSize) {
-   int i, j;
-   unsigned long byte, mask;
-
-   while (nSize--) {
-      byte = *pBuffer++;            // Get next byte.
-      crc = crc ^ byte;
-      for (j = 7; j >= 0; j--) {    // Do eight times.
-         mask = -(crc & 1);
-         crc = (crc >> 1) ^ (0xEDB88320 & mask);
-      }
-   }
-   return crc;
-}
-
 unsigned char CheckFirmware(char *name)
 {
     UPGRADE *pUpgrade = (UPGRADE*)sector_buffer;
@@ -55,6 +41,7 @@ unsigned char CheckFirmware(char *name)
     unsigned long rom_size;
     unsigned long rom_crc;
     unsigned long read_size;
+    UINT br;
     FIL file;
 
     Error = ERROR_FILE_NOT_FOUND;
@@ -68,8 +55,8 @@ unsigned char CheckFirmware(char *name)
         {
           clmt[0] = 99;
           file.cltbl = clmt;
-          if (f_lseek(&file, CREATE_LINKMAP) == FR_OK) {
-            FileReadNextBlock(&file, sector_buffer);
+          if (f_lseek(&file, CREATE_LINKMAP) == FR_OK &&
+              f_read(&file, sector_buffer, sizeof(UPGRADE), &br) == FR_OK && br == sizeof(UPGRADE)) {
             crc = ~CalculateCRC32(-1, sector_buffer, sizeof(UPGRADE) - 4);
             iprintf("Upgrade ROM size      : %lu\r", pUpgrade->rom.size);
             iprintf("Upgrade header CRC    : %08lX\r", pUpgrade->crc);
@@ -87,12 +74,14 @@ unsigned char CheckFirmware(char *name)
                         size = rom_size;
                         while (size)
                         {
-                            if (size > 512)
-                               read_size = 512;
+                            // read as much as fits, so the card transfers multiple sectors at once
+                            if (size > SECTOR_BUFFER_SIZE)
+                               read_size = SECTOR_BUFFER_SIZE;
                             else
                                read_size = size;
 
-                            FileReadNextBlock(&file, sector_buffer);
+                            if (f_read(&file, sector_buffer, read_size, &br) != FR_OK || br != read_size)
+                               break;
                             crc = CalculateCRC32(crc, sector_buffer, read_size);
                             size -= read_size;
                         }
@@ -112,7 +101,7 @@ unsigned char CheckFirmware(char *name)
             }
             else iprintf("Header CRC mismatch! from header: %08lX, calculated: %08lX\r", pUpgrade->crc, crc);
           }
-          else iprintf("Error creating linkmap\r");
+          else iprintf("Error reading upgrade header\r");
         }
         else iprintf("Upgrade file size too small: %llu\r", f_size(&file));
         f_close(&file);
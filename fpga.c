@@ -999,6 +999,7 @@ unsigned char fpga_init(const char *name) {
     ChangeDirectoryName("/");
 
     //eject all disk
+    FlushTrackCache();
     df[0].status = 0;
     df[1].status = 0;
     df[2].status = 0;
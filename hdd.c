@@ -283,7 +283,7 @@ static unsigned char HardFileSeek(hdfTYPE *pHDF, unsigned long lba)
 {
   FSIZE_t seek_pos = (FSIZE_t) lba << 9;
   FRESULT res;
-  res = f_lseek(&pHDF->idxfile->file, seek_pos);
+  res = IDXSeek(pHDF->idxfile, lba);
   if (res != FR_OK || f_tell(&pHDF->idxfile->file) != seek_pos) {
     hdd_debugf("Seek error: %llu, %llu", seek_pos, f_tell(&pHDF->idxfile->file));
     return 0;
@@ -339,6 +339,34 @@ static void WriteStatus(unsigned char status)
   DisableFpga();
 }
 
+#ifdef HAVE_QSPI
+// send sectors of a hardfile or card partition over QSPI, one transfer per
+// chunk. The next chunk is read into the other half of the sector buffer
+// while the DMA is still sending the previous one.
+static void QSPIReadSectors(hdfTYPE *pHDF, long lba, unsigned long blocks)
+{
+  unsigned char *buf = sector_buffer;
+  unsigned long n;
+  char started = 0;
+
+  while (blocks) {
+    n = MIN(blocks, SECTOR_BUFFER_SIZE/1024);
+    if ((pHDF->type & HDF_TYPEMASK) == HDF_FILE)
+      FileReadBlockEx(&pHDF->idxfile->file, buf, n);
+    else
+      disk_read(fs.pdrv, buf, lba, n);
+    if (started) qspi_end();
+    qspi_start_write();
+    qspi_write_block_start(buf, 512*n);
+    started = 1;
+    buf = (buf == sector_buffer) ? sector_buffer + SECTOR_BUFFER_SIZE/2 : sector_buffer;
+    lba += n;
+    blocks -= n;
+  }
+  if (started) qspi_end();
+}
+#endif
+
 static void WritePacket(unsigned char unit, const unsigned char *buf, unsigned short bufsize, unsigned short bytelimit, char lastpacket)
 {
   unsigned short bytes;
@@ -414,16 +442,13 @@ static void cdrom_generate_ecc(unsigned char *pBuffer, unsigned int lba)
 
 static void cdrom_playaudio()
 {
-  UINT br;
   unsigned char track = cue_gettrackbylba(cdrom.currentlba);
   if ((toc.tracks[track].type != SECTOR_AUDIO) || (toc.tracks[track].sector_size != 2352)) {
     cdrom.audiostatus = AUDIO_ERROR;
     return;
   }
   DISKLED_ON
-  int offset = (cdrom.currentlba - toc.tracks[track].start) * toc.tracks[track].sector_size + toc.tracks[track].offset;
-  f_lseek(&toc.file->file, offset);
-  f_read(&toc.file->file, sector_buffer, 2352, &br);
+  cue_readsector(cdrom.currentlba, 0, sector_buffer, 2352);
   EnableFpga();
   SPI(CMD_IDE_CDDA_WR); // write cdda command
   SPI(0x00);
@@ -442,7 +467,6 @@ static void cdrom_playaudio()
 
 static void PKT_Read(unsigned char unit, unsigned int lba, unsigned int len, unsigned short bytelimit, unsigned short blocksize)
 {
-  UINT br;
   unsigned char *pBuffer;
   if (!toc.valid) {
     cdrom_setsense(SENSEKEY_NOT_READY, 0x3a, 0);
@@ -455,7 +479,7 @@ static void PKT_Read(unsigned char unit, unsigned int lba, unsigned int len, uns
 
   while (len--) {
     unsigned char track = cue_gettrackbylba(lba);
-    int offset = (lba - toc.tracks[track].start) * toc.tracks[track].sector_size + toc.tracks[track].offset;
+    int offset = 0;
 
     if ((blocksize == 2048 && toc.tracks[track].type != SECTOR_DATA_MODE1 && toc.tracks[track].type != SECTOR_DATA_MODE2) ||
         (blocksize != 2048 && blocksize !=2352) ||
@@ -473,8 +497,7 @@ static void PKT_Read(unsigned char unit, unsigned int lba, unsigned int len, uns
        pBuffer+=16;
     }
     hdd_debugf("lba: %d track: %d, offset: %d, blocksize: %d sector_size: %d", lba, track, offset, blocksize, toc.tracks[track].sector_size);
-    f_lseek(&toc.file->file, offset);
-    f_read(&toc.file->file, pBuffer, MIN(toc.tracks[track].sector_size, blocksize), &br);
+    cue_readsector(lba, offset, pBuffer, MIN(toc.tracks[track].sector_size, blocksize));
     if (blocksize == 2352 && toc.tracks[track].sector_size == 2048) {
        cdrom_generate_ecc(sector_buffer, lba);
     }
@@ -1328,24 +1351,20 @@ static inline void ATA_ReadSectors(unsigned char* tfr, unsigned short sector, un
           } else {
 #endif
             blocks = blk;
+#ifdef HAVE_QSPI
+            if (minimig_v2() && !verify) {
+              QSPIReadSectors(&hdf[unit], 0, blocks);
+              blocks = 0;
+            }
+#endif
             while (blocks) {
               FileReadBlockEx(&hdf[unit].idxfile->file, sector_buffer, MIN(blocks, SECTOR_BUFFER_SIZE/512));
               if (!verify) {
-#ifdef HAVE_QSPI
-                if(minimig_v2()) {
-                  qspi_start_write();
-                  qspi_write_block(sector_buffer, 512*MIN(blocks, SECTOR_BUFFER_SIZE/512));
-                  qspi_end();
-                } else {
-#endif
                 EnableFpga();
                 spi8(CMD_IDE_DATA_WR); // write data command
                 spi_n(0x00, 5);
                 spi_write(sector_buffer, 512*MIN(blocks, SECTOR_BUFFER_SIZE/512));
                 DisableFpga();
-#ifdef HAVE_QSPI
-                }
-#endif
               }
               blocks-=MIN(blocks, SECTOR_BUFFER_SIZE/512);
             }
@@ -1371,25 +1390,21 @@ static inline void ATA_ReadSectors(unsigned char* tfr, unsigned short sector, un
         } else {
 #endif
           blocks = block_count;
+#ifdef HAVE_QSPI
+          if (minimig_v2() && !verify) {
+            QSPIReadSectors(&hdf[unit], lba+hdf[unit].offset, blocks);
+            lba+=blocks;
+            blocks = 0;
+          }
+#endif
           while (blocks) {
             disk_read(fs.pdrv, sector_buffer, lba+hdf[unit].offset, MIN(blocks, SECTOR_BUFFER_SIZE/512));
             if (!verify) {
-#ifdef HAVE_QSPI
-              if(minimig_v2()) {
-                qspi_start_write();
-                qspi_write_block(sector_buffer, 512*MIN(blocks, SECTOR_BUFFER_SIZE/512));
-                qspi_end();
-              } else {
-#else
               EnableFpga();
               spi8(CMD_IDE_DATA_WR); // write data command
               spi_n(0x00, 5);
               spi_write(sector_buffer, 512*MIN(blocks, SECTOR_BUFFER_SIZE/512));
               DisableFpga();
-#endif
-#ifdef HAVE_QSPI
-              }
-#endif
             }
             lba+=MIN(blocks, SECTOR_BUFFER_SIZE/512);
             blocks-=MIN(blocks, SECTOR_BUFFER_SIZE/512);
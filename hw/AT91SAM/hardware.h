@@ -101,6 +101,36 @@
 
 #define SECTOR_BUFFER_SIZE   4096
 
+// read-ahead cache of the 8 bit core sd card emulation
+#define SD_CACHE_LINES       1
+#define SD_CACHE_LINE_SIZE   1024
+
+// write-back buffer of the 8 bit core sd card emulation
+#define SD_WRBUF_LINES       1
+#define SD_WRBUF_LINE_SIZE   1024
+
+// cluster checkpoints of an image whose link map doesn't fit the index pool
+#define IDX_CHECKPOINTS      16
+
+// sorted listing of the directory shown in the file browser
+// (none, the SAM7S RAM can't spare the buffer)
+#define DIR_CACHE_SIZE       0
+
+// tracks of the Amiga floppy images kept in memory (5.6k each)
+// (none, sectors are read one by one into the sector buffer)
+#define FDD_TRACK_CACHE      0
+
+// tracks of the Atari ST floppy images kept in memory, and their max. length
+// (none, a track doesn't fit the SAM7S RAM either)
+#define FDC_TRACK_CACHE      0
+#define FDC_TRACK_SECTORS    11
+
+// no CD image read-ahead (CUE_READAHEAD_SECTORS), the ring doesn't fit either
+
+// delay between the bytes of a DMA file upload for the FEAT_DIO_DMA
+// speeds, in units of 32 MCLK cycles (0.67us)
+#define SPI_DIO_PACING       { 0, 3, 1, 0 }
+
 char mmc_inserted(void);
 char mmc_write_protected(void);
 void USART_Init(unsigned long baudrate);
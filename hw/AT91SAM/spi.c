@@ -150,6 +150,17 @@ void spi_write(const char *addr, uint16_t len) {
   *AT91C_SPI_PTCR = AT91C_PDC_TXTDIS; // disable transmitter
 }
 
+// DMA transfer to the FPGA with a delay of 32*delay MCLK cycles between
+// the bytes, for cores which cannot take the data at full SPI speed
+void spi_write_paced(const char *addr, uint16_t len, unsigned char delay) {
+  unsigned long csr = AT91C_SPI_CSR[2];
+
+  AT91C_SPI_CSR[2] = (csr & 0x00ffffff) | (delay << 24);
+  spi_write(addr, len);
+  spi_wait4xfer_end();
+  AT91C_SPI_CSR[2] = csr;
+}
+
 void spi_block_write(const char *addr) {
   spi_write(addr, 512);
 }
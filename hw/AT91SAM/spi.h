@@ -42,6 +42,7 @@ RAMFUNC void spi_block_read(char *addr);
 RAMFUNC void spi_read(char *addr, uint16_t len);
 void spi_block_write(const char *addr);
 void spi_write(const char *addr, uint16_t len);
+void spi_write_paced(const char *addr, uint16_t len, unsigned char delay);
 void spi_block(unsigned short num);
 
 /* OSD related SPI functions */
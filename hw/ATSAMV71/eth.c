@@ -10,8 +10,6 @@
 
 #include "user_io.h"
 
-extern unsigned char sector_buffer[SECTOR_BUFFER_SIZE];
-
 static struct _phy phy;
 static struct _phy_desc phy_desc;
 static struct _ethd ethd;
@@ -30,8 +28,20 @@ static char link_changed = 0;
 static unsigned long timerMAC;
 
 #define MAX_FRAMELEN 1536
+#define RX_FRAME_BUFFERS (MAX_FRAMELEN/ETH_RX_UNITSIZE)
+#define MAX_BATCH 8      // frames moved per direction and call at most
 static uint32_t old_status;
 
+// bridge statistics, reported with eth_debug when the MAC is resent
+static struct {
+	uint32_t tx_frames;  // FPGA -> GMAC
+	uint32_t tx_drops;   // TX queue full or frame too long
+	uint32_t tx_queued;  // TX queue depth, max since last report
+	uint32_t rx_frames;  // GMAC -> FPGA
+	uint32_t rx_drops;   // GMAC resource errors/overruns, broken frames
+	uint32_t rx_batch;   // frames in one call, max since last report
+} stats;
+
 static void PIOAIrqHandler()
 {
 	volatile uint32_t isr = PIOA->PIO_ISR;
@@ -99,41 +109,86 @@ int eth_poll()
 	if (CheckTimer(timerMAC)) {
 		user_io_eth_send_mac(mac);
 		timerMAC = GetTimer(2000);
-	}
-
-	if (!link) return 0;
-
-	uint32_t status = user_io_eth_get_status();
 
-	if(status != old_status) {
-		eth_debug("fpga status changed to cmd %x, eq=%d, prx=%d, ptx=%d, len=%d",
-		  status >> 24, (status & 0x40000)?1:0, (status & 0x20000)?1:0,
-		  (status & 0x10000)?1:0, status & 0xffff);
-		old_status = status;
+		// statistics registers clear on read
+		stats.rx_drops += GMAC0->GMAC_RRE + GMAC0->GMAC_ROE;
+		eth_debug("tx %lu frames, %lu drops, queue %lu; rx %lu frames, %lu drops, batch %lu",
+		  stats.tx_frames, stats.tx_drops, stats.tx_queued,
+		  stats.rx_frames, stats.rx_drops, stats.rx_batch);
+		stats.tx_queued = stats.rx_batch = 0;
 	}
 
-	if((status >> 24) == 0xa5) {
-		uint16_t len = status & 0xffff;
+	if (!link) return 0;
 
-		if(len <= MAX_FRAMELEN) {
-			user_io_eth_receive_tx_frame(sector_buffer, len);
-			//iprintf("sending packet: %d bytes\n", len);
-			//hexdump(sector_buffer, len, 0);
-			ethd_send(&ethd, 0, sector_buffer, len, 0);
+	// move frames until both directions are idle, the FPGA status is
+	// read again after each frame
+	struct _eth_sg rx_sg[RX_FRAME_BUFFERS];
+	struct _eth_sg_list rx_sgl;
+	uint32_t tx_n = 0, rx_n = 0;
+	char moved;
+
+	do {
+		uint32_t status = user_io_eth_get_status();
+		char changed = status != old_status;
+		moved = 0;
+
+		if(changed) {
+			eth_debug("fpga status changed to cmd %x, eq=%d, prx=%d, ptx=%d, len=%d",
+			  status >> 24, (status & 0x40000)?1:0, (status & 0x20000)?1:0,
+			  (status & 0x10000)?1:0, status & 0xffff);
+			old_status = status;
 		}
-	}
 
-	if(!(status & 0x20000)) {
+		// FPGA -> GMAC, read the frame straight into the TX descriptor buffer
+		if((status >> 24) == 0xa5 && tx_n < MAX_BATCH) {
+			uint16_t len = status & 0xffff;
+			uint8_t *buf;
+
+			if(len > MAX_FRAMELEN) {
+				// left in the FPGA as before, count it only once
+				if(changed) stats.tx_drops++;
+			} else if((buf = ethd_get_tx_buffer(&ethd, 0))) {
+				user_io_eth_receive_tx_frame(buf, len);
+				//iprintf("sending packet: %d bytes\n", len);
+				//hexdump(buf, len, 0);
+				if(ethd_send(&ethd, 0, NULL, len, 0) == ETH_OK) {
+					stats.tx_frames++;
+					uint32_t queued = ethd_get_tx_load(&ethd, 0);
+					if(queued > stats.tx_queued) stats.tx_queued = queued;
+				} else
+					stats.tx_drops++;
+				tx_n++;
+				moved = 1;
+			}
+			// otherwise the TX queue is full, the frame waits in the FPGA
+		}
 
-		uint32_t recv_size = 0;
-		if (ethd_poll(&ethd, 0, sector_buffer, SECTOR_BUFFER_SIZE, &recv_size) == ETH_OK) {
-			if (recv_size) {
-				user_io_eth_send_rx_frame(sector_buffer, recv_size);
+		// GMAC -> FPGA, stream the frame from the RX descriptor buffers
+		if(!(status & 0x20000) && rx_n < MAX_BATCH) {
+			uint32_t recv_size = 0;
+			uint8_t res;
+
+			rx_sgl.size = RX_FRAME_BUFFERS;
+			rx_sgl.entries = rx_sg;
+			res = ethd_poll_sg(&ethd, 0, &rx_sgl, &recv_size);
+			if (res == ETH_OK) {
+				user_io_eth_send_rx_start();
+				for(int i = 0; i < rx_sgl.size; i++)
+					user_io_eth_send_rx_data(rx_sg[i].buffer, rx_sg[i].size);
+				user_io_eth_send_rx_end();
 				//iprintf("received packet: %d bytes\n", recv_size);
-				//hexdump(sector_buffer, recv_size, 0);
+				ethd_poll_release(&ethd, 0, &rx_sgl);
+				stats.rx_frames++;
+				rx_n++;
+				moved = 1;
+			} else if (res == ETH_SIZE_TOO_SMALL) {
+				stats.rx_drops++;
+				moved = 1;
 			}
 		}
-	}
+	} while(moved);
+
+	if(rx_n > stats.rx_batch) stats.rx_batch = rx_n;
 	return 0;
 }
 
@@ -142,6 +142,31 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define SECTOR_BUFFER_SIZE   8192
 
+// read-ahead cache of the 8 bit core sd card emulation
+#define SD_CACHE_LINES       8
+#define SD_CACHE_LINE_SIZE   4096
+
+// write-back buffer of the 8 bit core sd card emulation
+#define SD_WRBUF_LINES       4
+#define SD_WRBUF_LINE_SIZE   8192
+
+// sorted listing of the directory shown in the file browser
+#define DIR_CACHE_SIZE       65536
+
+// tracks of the Amiga floppy images kept in memory (5.6k each)
+#define FDD_TRACK_CACHE      8
+
+// tracks of the Atari ST floppy images kept in memory, and their max. length
+#define FDC_TRACK_CACHE      4
+#define FDC_TRACK_SECTORS    36
+
+// raw CD sectors read ahead for streaming CD image reads
+#define CUE_READAHEAD_SECTORS 16
+
+// delay between the bytes of a DMA file upload for the FEAT_DIO_DMA
+// speeds, in units of 32 MCLK cycles (0.22us)
+#define SPI_DIO_PACING       { 0, 8, 3, 0 }
+
 void __init_hardware();
 
 char mmc_inserted();
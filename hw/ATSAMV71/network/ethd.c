@@ -310,6 +310,98 @@ uint8_t ethd_poll(struct _ethd* ethd, uint8_t queue, uint8_t* buffer, uint32_t b
 	return ETH_RX_NULL;
 }
 
+void* ethd_get_tx_buffer(struct _ethd* ethd, uint8_t queue)
+{
+	struct _ethd_queue* q = &ethd->queues[queue];
+
+	if (!RING_SPACE(q->tx_head, q->tx_tail, q->tx_size))
+		return NULL;
+	return (void*)q->tx_desc[q->tx_head].addr;
+}
+
+uint8_t ethd_poll_sg(struct _ethd* ethd, uint8_t queue, struct _eth_sg_list* sgl, uint32_t* recv_size)
+{
+	struct _ethd_queue* q = &ethd->queues[queue];
+	struct _eth_desc *desc;
+	uint32_t idx;
+	uint32_t max = sgl->size;
+	uint32_t n = 0;
+	uint8_t sof = 0;
+
+	/* Set the default return value */
+	*recv_size = 0;
+	sgl->size = 0;
+
+	/* Process RX descriptors */
+	idx = q->rx_head;
+	desc = &q->rx_desc[idx];
+	while (desc->addr & ETH_RX_ADDR_OWN) {
+		/* A start of frame has been received, discard previous fragments */
+		if (desc->status & ETH_RX_STATUS_SOF) {
+			while (idx != q->rx_head) {
+				desc = &q->rx_desc[q->rx_head];
+				desc->addr &= ~ETH_RX_ADDR_OWN;
+				RING_INC(q->rx_head, q->rx_size);
+			}
+			desc = &q->rx_desc[idx];
+			sof = 1;
+			n = 0;
+		}
+
+		/* Increment the index */
+		RING_INC(idx, q->rx_size);
+
+		if (sof) {
+			if (idx == q->rx_head || n == max) {
+				eth_info("no EOF (buffers probably too small)");
+
+				do {
+					desc = &q->rx_desc[q->rx_head];
+					desc->addr &= ~ETH_RX_ADDR_OWN;
+					RING_INC(q->rx_head, q->rx_size);
+				} while (idx != q->rx_head);
+				return ETH_SIZE_TOO_SMALL;
+			}
+
+			/* Point the list to the buffer */
+			sgl->entries[n].buffer = (void*)(desc->addr & ETH_RX_ADDR_MASK);
+			sgl->entries[n].size = ETH_RX_UNITSIZE;
+			n++;
+
+			/* An end of frame has been received, the last buffer
+			 * holds the rest of the frame */
+			if (desc->status & ETH_RX_STATUS_EOF) {
+				*recv_size = desc->status & ETH_RX_STATUS_LENGTH_MASK;
+				if (*recv_size > (n - 1) * ETH_RX_UNITSIZE)
+					sgl->entries[n - 1].size = *recv_size - (n - 1) * ETH_RX_UNITSIZE;
+				sgl->size = n;
+				return ETH_OK;
+			}
+		}
+
+		/* SOF has not been detected, skip the fragment */
+		else {
+			desc->addr &= ~ETH_RX_ADDR_OWN;
+			q->rx_head = idx;
+		}
+
+		/* Process the next buffer */
+		desc = &q->rx_desc[idx];
+	}
+	return ETH_RX_NULL;
+}
+
+void ethd_poll_release(struct _ethd* ethd, uint8_t queue, const struct _eth_sg_list* sgl)
+{
+	struct _ethd_queue* q = &ethd->queues[queue];
+	uint32_t i;
+
+	for (i = 0; i < sgl->size; i++) {
+		q->rx_desc[q->rx_head].addr &= ~ETH_RX_ADDR_OWN;
+		RING_INC(q->rx_head, q->rx_size);
+	}
+}
+
 void ethd_set_rx_callback(struct _ethd *ethd, uint8_t queue, ethd_callback_t callback)
 {
 	ethd->op->set_rx_callback(ethd, queue, callback);
@@ -303,6 +303,27 @@ extern uint32_t ethd_get_tx_load(struct _ethd* ethd, uint8_t queue);
  */
 extern uint8_t ethd_poll(struct _ethd* ethd, uint8_t queue, uint8_t* buffer, uint32_t buffer_size, uint32_t* recv_size);
 
+/**
+ * \brief Get the buffer of the next free TX descriptor, so a frame can be
+ * built in place and sent with ethd_send() with a NULL buffer.
+ *  \param ethd Pointer to ETH Driver instance.
+ *  \return     Buffer of ETH_TX_UNITSIZE bytes, NULL if the TX queue is full
+ */
+extern void* ethd_get_tx_buffer(struct _ethd* ethd, uint8_t queue);
+
+/**
+ * \brief Receive a packet with ETH without copying it.
+ * The list is pointed to the RX buffers holding the next complete frame.
+ * The buffers stay valid until they are returned with ethd_poll_release().
+ *  \param ethd Pointer to ETH Driver instance.
+ *  \param sgl              List to fill, size is the number of entries
+ *  \param recv_size        Received size
+ *  \return                 OK, no data, or frame too large for the list
+ */
+extern uint8_t ethd_poll_sg(struct _ethd* ethd, uint8_t queue, struct _eth_sg_list* sgl, uint32_t* recv_size);
+
+extern void ethd_poll_release(struct _ethd* ethd, uint8_t queue, const struct _eth_sg_list* sgl);
+
 extern void ethd_set_rx_callback(struct _ethd *ethd, uint8_t queue, ethd_callback_t callback);
 
 /**
@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "hardware.h"
 
 static uint8_t* dst;
+static char busy;   // block transfer running
 
 void qspi_init() {
   PMC->PMC_PCER1 = (1 << (ID_QSPI0 - 32));
@@ -41,9 +42,12 @@ void qspi_write(uint8_t data) {
   *dst++ = data;
 }
 
-void qspi_write_block(const uint8_t *data, uint32_t len) {
+// start the DMA transfer of a block and return, the previous block is
+// finished first. The data must stay untouched until the transfer ends.
+void qspi_write_block_start(const uint8_t *data, uint32_t len) {
 
-  XDMAC0->XDMAC_GD = XDMAC_GD_DI1;
+  qspi_write_block_wait();
+  XDMAC0->XDMAC_GD = XDMAC_GD_DI3;
   XDMAC0->XDMAC_CH[DMA_CH_QSPI_TRANS].XDMAC_CC = XDMAC_CC_TYPE_MEM_TRAN
                                                | XDMAC_CC_MBSIZE_SINGLE
                                                | XDMAC_CC_DSYNC_MEM2PER
@@ -61,13 +65,25 @@ void qspi_write_block(const uint8_t *data, uint32_t len) {
   XDMAC0->XDMAC_CH[DMA_CH_QSPI_TRANS].XDMAC_CIE = XDMAC_CIE_BIE;
   // Start the transmitter
   XDMAC0->XDMAC_GE = XDMAC_GE_EN3;
-
-  // Wait for end of transfer
-  while (!(XDMAC0->XDMAC_CH[DMA_CH_QSPI_TRANS].XDMAC_CIS & XDMAC_CIS_BIS));
+  busy = 1;
   dst += len;
 }
 
+// wait for the end of the running block transfer
+void qspi_write_block_wait() {
+  if (busy) {
+    while (!(XDMAC0->XDMAC_CH[DMA_CH_QSPI_TRANS].XDMAC_CIS & XDMAC_CIS_BIS));
+    busy = 0;
+  }
+}
+
+void qspi_write_block(const uint8_t *data, uint32_t len) {
+  qspi_write_block_start(data, len);
+  qspi_write_block_wait();
+}
+
 void qspi_end() {
+  qspi_write_block_wait();
   QSPI0->QSPI_CR = QSPI_CR_LASTXFER;
   while (!(QSPI0->QSPI_SR & QSPI_SR_INSTRE));
 }
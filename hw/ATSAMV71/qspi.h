@@ -27,6 +27,8 @@ void qspi_init();
 void qspi_start_write();
 void qspi_write(uint8_t data);
 void qspi_write_block(const uint8_t *data, uint32_t len);
+void qspi_write_block_start(const uint8_t *data, uint32_t len);
+void qspi_write_block_wait();
 void qspi_end();
 
 #endif // QSPI_H
@@ -182,6 +182,18 @@ void spi_write(const char *addr, uint16_t len)
     spi_transfer(addr, 0, len);
 }
 
+// DMA transfer to the FPGA with a delay of 32*delay MCLK cycles between
+// the bytes, for cores which cannot take the data at full SPI speed
+void spi_write_paced(const char *addr, uint16_t len, unsigned char delay)
+{
+    uint32_t csr = SPI0->SPI_CSR[3];
+
+    SPI0->SPI_CSR[3] = (csr & ~SPI_CSR_DLYBCT_Msk) | SPI_CSR_DLYBCT(delay);
+    spi_write(addr, len);
+    spi_wait4xfer_end();
+    SPI0->SPI_CSR[3] = csr;
+}
+
 void spi_block_write(const char *addr)
 {
   spi_write(addr, 512);
@@ -1,37 +1,345 @@
 #include <stdio.h>
+#include <string.h>
 #include "idxfile.h"
 #include "hardware.h"
+#include "mist_cfg.h"
 
 IDXFile sd_image[SD_IMAGES];
 
-void IDXIndex(IDXFile *pIDXF) {
-    // builds index to speed up hard file seek
+// link maps and checkpoints of all images
+static DWORD idx_pool[IDX_POOL_SIZE];
+
+// Index cache: the link maps of recently indexed files are kept in a file
+// in the root directory, so mounting the same image again doesn't have to
+// walk its FAT chain. The link map holds absolute cluster numbers, so it's
+// valid as long as the start cluster, the size and the modification time of
+// the file didn't change. The file starts with a directory sector, followed
+// by one SZ_TBL sized table per slot.
+#define IDX_CACHE_FILE   "/IDXCACHE.DAT"
+#define IDX_CACHE_MAGIC  0x43584449 // "IDXC"
+#define IDX_CACHE_SLOTS  16
+#define IDX_CACHE_TABLE(n) (512 + (FSIZE_t)(n) * SZ_TBL * sizeof(DWORD))
+
+typedef struct {
+  DWORD magic;
+  DWORD tblsize;
+  DWORD stamp;
+  DWORD reserved;
+  struct {
+    DWORD sclust;
+    DWORD entries; // 0 - unused slot
+    FSIZE_t size;
+    DWORD mtime;
+    DWORD stamp;   // replacement order
+  } slot[IDX_CACHE_SLOTS];
+} idx_cache_dir_t;
+
+static idx_cache_dir_t idx_cache_dir;
+
+// modification date/time of a just opened file from its directory entry
+static DWORD idx_file_mtime(FIL *fp) {
+  FATFS *fs = fp->obj.fs;
+  BYTE *p;
+
+#if FF_FS_EXFAT
+  if (fs->fs_type == FS_EXFAT) {
+    p = fs->dirbuf + 12; // XDIR_ModTime
+  } else
+#endif
+  {
+    if (fs->winsect != fp->dir_sect) return 0;
+    p = fp->dir_ptr + 22; // DIR_ModTime
+  }
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((DWORD)p[3] << 24);
+}
+
+static char idx_cache_read_dir(FIL *fp) {
+  UINT br;
+
+  if (f_read(fp, &idx_cache_dir, sizeof(idx_cache_dir), &br) != FR_OK || br != sizeof(idx_cache_dir) ||
+      idx_cache_dir.magic != IDX_CACHE_MAGIC || idx_cache_dir.tblsize != SZ_TBL) {
+    memset(&idx_cache_dir, 0, sizeof(idx_cache_dir));
+    idx_cache_dir.magic = IDX_CACHE_MAGIC;
+    idx_cache_dir.tblsize = SZ_TBL;
+    return 0;
+  }
+  return 1;
+}
+
+static int idx_cache_find(IDXFile *pIDXF) {
+  FIL *file = &pIDXF->file;
+
+  for (int i = 0; i < IDX_CACHE_SLOTS; i++) {
+    if (idx_cache_dir.slot[i].entries &&
+        idx_cache_dir.slot[i].sclust == file->obj.sclust &&
+        idx_cache_dir.slot[i].size == f_size(file) &&
+        idx_cache_dir.slot[i].mtime == pIDXF->mtime)
+      return i;
+  }
+  return -1;
+}
+
+// load the link map into the table of the file, size is the free space there
+static char idx_cache_load(IDXFile *pIDXF, DWORD *tbl, DWORD size) {
+  FIL fil;
+  UINT br;
+  int slot;
+  char ok = 0;
+
+  if (f_open(&fil, IDX_CACHE_FILE, FA_READ) != FR_OK) return 0;
+  if (idx_cache_read_dir(&fil) && (slot = idx_cache_find(pIDXF)) >= 0 &&
+      idx_cache_dir.slot[slot].entries <= size &&
+      f_lseek(&fil, IDX_CACHE_TABLE(slot)) == FR_OK &&
+      f_read(&fil, tbl, idx_cache_dir.slot[slot].entries * sizeof(DWORD), &br) == FR_OK &&
+      br == idx_cache_dir.slot[slot].entries * sizeof(DWORD) &&
+      tbl[0] == idx_cache_dir.slot[slot].entries)
+    ok = 1;
+
+  f_close(&fil);
+  return ok;
+}
+
+static void idx_cache_store(IDXFile *pIDXF, DWORD *tbl) {
+  FIL *file = &pIDXF->file;
+  FIL fil;
+  UINT bw;
+  int slot, i;
+
+  if (tbl[0] > SZ_TBL) return;
+  if (f_open(&fil, IDX_CACHE_FILE, FA_READ | FA_WRITE | FA_OPEN_ALWAYS) != FR_OK) {
+    iprintf("Cannot open %s\n", IDX_CACHE_FILE);
+    return;
+  }
+  idx_cache_read_dir(&fil);
+
+  // replace an older index of the same file, or a free, or the oldest slot
+  slot = 0;
+  for (i = 0; i < IDX_CACHE_SLOTS; i++) {
+    if (idx_cache_dir.slot[i].entries && idx_cache_dir.slot[i].sclust == file->obj.sclust) {
+      slot = i;
+      break;
+    }
+    if (!idx_cache_dir.slot[i].entries ||
+        (idx_cache_dir.slot[slot].entries && idx_cache_dir.slot[i].stamp < idx_cache_dir.slot[slot].stamp))
+      slot = i;
+  }
+
+  // invalidate the slot until the table is written
+  idx_cache_dir.slot[slot].entries = 0;
+  if (f_lseek(&fil, 0) == FR_OK && f_write(&fil, &idx_cache_dir, sizeof(idx_cache_dir), &bw) == FR_OK &&
+      f_lseek(&fil, IDX_CACHE_TABLE(slot)) == FR_OK &&
+      f_write(&fil, tbl, tbl[0] * sizeof(DWORD), &bw) == FR_OK && bw == tbl[0] * sizeof(DWORD)) {
+    idx_cache_dir.slot[slot].sclust = file->obj.sclust;
+    idx_cache_dir.slot[slot].entries = tbl[0];
+    idx_cache_dir.slot[slot].size = f_size(file);
+    idx_cache_dir.slot[slot].mtime = pIDXF->mtime;
+    idx_cache_dir.slot[slot].stamp = ++idx_cache_dir.stamp;
+    if (f_lseek(&fil, 0) != FR_OK || f_write(&fil, &idx_cache_dir, sizeof(idx_cache_dir), &bw) != FR_OK)
+      iprintf("Error writing %s\n", IDX_CACHE_FILE);
+  }
+  f_close(&fil);
+}
+
+// pool entries held by an image, until IDXClose() or a new index drops them
+static char idx_pool_used(IDXFile *f) {
+  return f->file.obj.fs && f->clmt && f->tblsize;
+}
+
+// end of the free pool space from p on, the entries of closed files are free
+static DWORD *idx_pool_end(IDXFile *pIDXF, DWORD *p) {
+  DWORD *end = idx_pool + IDX_POOL_SIZE;
+
+  for (int i = 0; i < SD_IMAGES; i++) {
+    IDXFile *f = &sd_image[i];
+    if (f != pIDXF && idx_pool_used(f) && f->clmt >= p && f->clmt < end)
+      end = f->clmt;
+  }
+  return end;
+}
+
+// hand the largest free part of the pool to the file
+static DWORD idx_pool_alloc(IDXFile *pIDXF) {
+  DWORD *p, size, n;
+
+  pIDXF->clmt = idx_pool;
+  size = idx_pool_end(pIDXF, idx_pool) - idx_pool;
+  for (int i = 0; i < SD_IMAGES; i++) {
+    IDXFile *f = &sd_image[i];
+    if (f == pIDXF || !idx_pool_used(f)) continue;
+    p = f->clmt + f->tblsize;
+    n = idx_pool_end(pIDXF, p) - p;
+    if (n > size) {
+      pIDXF->clmt = p;
+      size = n;
+    }
+  }
+  return size;
+}
+
+// sparse index for files whose link map doesn't fit: the cluster before every
+// 2^ckshift-th cluster boundary is recorded, so a seek follows the cluster
+// chain only from the nearest checkpoint
+static DWORD idx_checkpoints(IDXFile *pIDXF, DWORD *tbl, DWORD size) {
+  FIL *file = &pIDXF->file;
+  DWORD bcs = (DWORD)file->obj.fs->csize << 9;
+  DWORD clusters = (f_size(file) + bcs - 1) / bcs;
+  DWORD i, n;
+  BYTE shift = 0;
+
+  if (!clusters) return 0;
+  while (((clusters - 1) >> shift) > size) shift++;
+  n = (clusters - 1) >> shift;
+  for (i = 0; i < n; i++) {
+    if (f_lseek(file, ((FSIZE_t)(i + 1) << shift) * bcs) != FR_OK) return 0;
+    tbl[i] = file->clust;
+  }
+  f_lseek(file, 0);
+  pIDXF->ckpt = tbl;
+  pIDXF->ckpts = n;
+  pIDXF->ckshift = shift;
+  pIDXF->ckclust = file->obj.sclust;
+  return n;
+}
+
+DWORD IDXIndexAt(IDXFile *pIDXF, BYTE idx, BYTE files) {
+    // builds index to speed up hard file seek into the index pool. The files
+    // of a multi-file CD image share the pool entries of the image: file idx
+    // of files is indexed behind the entries of the ones before it, file 0
+    // starts a new index. Returns the pool entries used by the file.
     FIL *file = &pIDXF->file;
     unsigned long  time = GetRTTC();
-    FRESULT res;
+    DWORD offset = 0, size = 0, *tbl = 0, n;
+    BYTE left = idx < files ? files - idx : 1;  // files still to be indexed, this one included
+    char cache = 0, loaded;
+    FRESULT res = FR_NOT_ENOUGH_CORE;
+
+    file->cltbl = 0;
+    pIDXF->ckpts = 0;
+    if (!idx) {
+      // a new index replaces the old one
+      pIDXF->tblsize = pIDXF->ckused = 0;
+      size = idx_pool_alloc(pIDXF);
+    } else if (pIDXF->clmt) {
+      offset = pIDXF->tblsize;
+      size = idx_pool_end(pIDXF, pIDXF->clmt + offset) - (pIDXF->clmt + offset);
+    }
+
+    if (size) {
+      tbl = pIDXF->clmt + offset;
+      tbl[0] = size;
+      file->cltbl = tbl;
+
+      // empty files have no clusters, and without a time stamp
+      // the file cannot be told apart from a rewritten one
+      cache = mist_cfg.index_cache && file->obj.sclust && pIDXF->mtime;
+      if (cache) {
+        DISKLED_ON
+        loaded = idx_cache_load(pIDXF, tbl, size);
+        DISKLED_OFF
+        if (loaded) {
+          pIDXF->tblsize = offset + tbl[0];
+          time = GetRTTC() - time;
+          iprintf("File index loaded from cache in %lu ms, index size = %d\n", time, tbl[0]);
+          return tbl[0];
+        }
+        tbl[0] = size;
+      }
+
+      DISKLED_ON
+      res = f_lseek(file, CREATE_LINKMAP);
+      DISKLED_OFF
+    }
+
+    if (res == FR_NOT_ENOUGH_CORE) {
+      // fall back to checkpoints in the file's share of the free pool entries,
+      // or of the few entries of the image itself, so a seek never walks the
+      // whole chain. The files still to come get the rest.
+      file->cltbl = 0;
+      res = FR_INT_ERR;
+      DISKLED_ON
+      n = (IDX_CHECKPOINTS - pIDXF->ckused) / left;
+      if (size / left && size / left >= n) {
+        if (idx_checkpoints(pIDXF, pIDXF->clmt + offset, size / left)) {
+          pIDXF->tblsize = offset + pIDXF->ckpts;
+          res = FR_OK;
+        }
+      } else if (pIDXF->ckused < IDX_CHECKPOINTS) {
+        if (!idx) pIDXF->clmt = 0;
+        if (idx_checkpoints(pIDXF, pIDXF->ckbuf + pIDXF->ckused, n ? n : 1)) {
+          pIDXF->ckused += pIDXF->ckpts;
+          res = FR_OK;
+        }
+      }
+      DISKLED_OFF
+      if (res == FR_OK) {
+        time = GetRTTC() - time;
+        iprintf("File indexed in %lu ms, %d checkpoints every %d clusters\n", time, pIDXF->ckpts, 1 << pIDXF->ckshift);
+        return pIDXF->tblsize - offset;
+      }
+    }
 
-    pIDXF->clmt[0] = SZ_TBL;
-    file->cltbl = pIDXF->clmt;
-    DISKLED_ON
-    res = f_lseek(file, CREATE_LINKMAP);
-    DISKLED_OFF
     if (res != FR_OK) {
       iprintf("Error indexing (%d), continuing without indices\n", res);
       file->cltbl = 0;
-    } else {
-      time = GetRTTC() - time;
-      iprintf("File indexed in %lu ms, index size = %d\n", time, pIDXF->clmt[0]);
+      if (!idx) pIDXF->clmt = 0;
+      return 0;
     }
+    time = GetRTTC() - time;
+    pIDXF->tblsize = offset + tbl[0];
+    iprintf("File indexed in %lu ms, index size = %d\n", time, tbl[0]);
+    if (cache) {
+      DISKLED_ON
+      idx_cache_store(pIDXF, tbl);
+      DISKLED_OFF
+    }
+    return tbl[0];
+}
+
+void IDXIndex(IDXFile *pIDXF) {
+    IDXIndexAt(pIDXF, 0, 1);
 }
 
 unsigned char IDXOpen(IDXFile *file, const char *name, char mode) {
-  return f_open(&(file->file), name, mode);
+  FRESULT res;
+
+  // pool entries of a closed file may be in use by others already
+  if (!file->file.obj.fs) {
+    file->clmt = 0;
+    file->tblsize = file->ckpts = 0;
+  }
+  res = f_open(&(file->file), name, mode);
+  file->mtime = (res == FR_OK) ? idx_file_mtime(&(file->file)) : 0;
+  return res;
 }
 
 void IDXClose(IDXFile *file) {
   f_close(&(file->file));
+  // hand the pool entries back, even if the file object was stale already
+  file->clmt = 0;
+  file->tblsize = file->ckpts = 0;
+}
+
+unsigned char IDXSeekPos(IDXFile *pIDXF, FSIZE_t ofs) {
+  FIL *file = &pIDXF->file;
+  DWORD bcs, cl, cur, i;
+
+  // without a link map start from the nearest checkpoint, unless the
+  // current position is closer. A seek past the end (which f_lseek()
+  // extends writable files to) starts from the last checkpoint
+  if (pIDXF->ckpts && file->obj.sclust == pIDXF->ckclust && ofs) {
+    bcs = (DWORD)file->obj.fs->csize << 9;
+    cl = ((ofs < f_size(file) ? ofs : f_size(file)) - 1) / bcs;
+    i = (cl + 1) >> pIDXF->ckshift;
+    if (i > pIDXF->ckpts) i = pIDXF->ckpts;
+    cur = (file->fptr - 1) / bcs;
+    if (i && !(file->fptr && cur <= cl && cur >= (i << pIDXF->ckshift) - 1)) {
+      file->fptr = ((FSIZE_t)i << pIDXF->ckshift) * bcs;
+      file->clust = pIDXF->ckpt[i - 1];
+    }
+  }
+  return f_lseek(file, ofs);
 }
 
 unsigned char IDXSeek(IDXFile *file, unsigned long lba) {
-  return f_lseek(&(file->file), (FSIZE_t) lba << 9);
+  return IDXSeekPos(file, (FSIZE_t) lba << 9);
 }
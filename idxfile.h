@@ -25,11 +25,31 @@
 #endif
 #define SD_IMAGES 4
 
+// link map entries shared by all images, handed out by the actual
+// fragment count of the files
+#ifndef IDX_POOL_SIZE
+#define IDX_POOL_SIZE (SD_IMAGES * SZ_TBL)
+#endif
+
+// checkpoints of each image for when the pool is used up, a seek follows
+// at most 1/IDX_CHECKPOINTS of the cluster chain then
+#ifndef IDX_CHECKPOINTS
+#define IDX_CHECKPOINTS 64
+#endif
+
 typedef struct
 {
 	char valid;
 	FIL file;
-	DWORD clmt[SZ_TBL];
+	DWORD mtime;	// modification date/time, part of the index cache key
+	DWORD *clmt;	// link map or checkpoints in the index pool, 0: no index
+	DWORD tblsize;	// pool entries used
+	DWORD *ckpt;	// checkpoints when the link map didn't fit
+	DWORD ckpts;	// number of checkpoints
+	DWORD ckclust;	// start cluster of the checkpointed file
+	BYTE ckshift;	// clusters between checkpoints (log2)
+	BYTE ckused;	// ckbuf entries taken by the files of the image
+	DWORD ckbuf[IDX_CHECKPOINTS];
 } IDXFile;
 
 // sd_image slots:
@@ -47,6 +67,11 @@ static inline unsigned char IDXRead(IDXFile *file, unsigned char *pBuffer, uint8
   return f_read(&(file->file), pBuffer, 512<<blksz, &br);
 }
 
+// read up to count sectors, br returns the number of bytes actually read
+static inline unsigned char IDXReadMultiple(IDXFile *file, unsigned char *pBuffer, UINT count, UINT *br) {
+  return f_read(&(file->file), pBuffer, count<<9, br);
+}
+
 static inline unsigned char IDXWrite(IDXFile *file, unsigned char *pBuffer, uint8_t blksz) {
   UINT bw;
   return f_write(&(file->file), pBuffer, 512<<blksz, &bw);
@@ -55,6 +80,8 @@ static inline unsigned char IDXWrite(IDXFile *file, unsigned char *pBuffer, uint
 unsigned char IDXOpen(IDXFile *file, const char *name, char mode);
 void IDXClose(IDXFile *file);
 unsigned char IDXSeek(IDXFile *file, unsigned long lba);
+unsigned char IDXSeekPos(IDXFile *file, FSIZE_t ofs);
 void IDXIndex(IDXFile *pIDXF);
+DWORD IDXIndexAt(IDXFile *pIDXF, BYTE file, BYTE files);
 
 #endif
@@ -19,8 +19,16 @@
 //// defines ////
 #define INI_EOT                 4 // End-Of-Transmission
 
-#define INI_BUF_SIZE            512
+#ifdef INI_PARSER_TEST
+#define INI_BUF_SIZE            4096
+#else
+#define INI_BUF_SIZE            SECTOR_BUFFER_SIZE
+#endif
 #define INI_LINE_SIZE           140
+// var lines remembered for in-place saving. Enough for the minimig config
+// (23 vars) and the core .cfg files, files with more var lines (like a
+// full mist.ini) are always rewritten as a whole
+#define INI_LAYOUT_SIZE         32
 
 #define INI_SECTION_START       '['
 #define INI_SECTION_END         ']'
@@ -44,60 +52,158 @@
 #define CHAR_TO_LOWERCASE(c)    ({ char _c = (c); if (CHAR_IS_ALPHA_UPPER(_c)) _c = _c - 'A' + 'a'; _c;})
 
 
+//// type definitions ////
+typedef struct {
+  uint16_t pos;  // file position of the value
+  uint8_t  len;  // bytes the value occupies in the file
+  uint8_t  var;  // var id
+  uint32_t sum;  // hash of the value text
+} ini_layout_t;
+
+
 //// debug func ////
 #ifdef INI_PARSER_TEST
 #define ini_parser_debugf(a, ...) fprintf(stderr, a "\n", __VA_ARGS__)
+void siprintf(char *str, const char *format, ...);
 #endif
 
 //// globals ////
 #ifdef INI_PARSER_TEST
 FILE* ini_fp = NULL;
-char  sector_buffer[INI_BUF_SIZE] = {0};
-int   ini_size=0;
+static char ini_buf[INI_BUF_SIZE];
 #else
 FIL   ini_file;
+#define ini_buf ((char*)sector_buffer)
 #endif
 
-static int ini_pt = 0;
+static int ini_pt = 0;       // file position of the next character
+static int ini_buf_pos = 0;  // file position of the buffered chunk
+static int ini_buf_len = 0;  // bytes in the buffered chunk
 
-//// ini_getch() ////
-static char ini_getch()
+// sorted var table, looked up with a binary search
+static char ini_vars_sorted = 0;
+
+// value span of the last line read
+static int ini_val_pos, ini_val_end;
+static uint32_t ini_val_sum;
+
+// var lines of the last parsed or saved file, in file order. If a save
+// produces the same lines and every new value fits, ini_save() patches
+// the changed values in place instead of rewriting the whole file.
+static ini_layout_t ini_layout[INI_LAYOUT_SIZE];
+static int ini_layout_cnt = -1;  // -1: no usable layout
+static const ini_var_t* ini_layout_vars;
+static uint32_t ini_layout_name;
+static int ini_layout_size;
+
+// ini_save() output state, the file is created on the first flush
+static const char* ini_out_name;
+static int ini_out_pos;          // bytes already flushed
+static char ini_out_open;        // 0: not yet, 1: open, -1: failed
+
+
+//// ini_read_chunk() ////
+static int ini_read_chunk()
+{
+  ini_buf_pos += ini_buf_len;
+  #ifdef INI_PARSER_TEST
+  ini_buf_len = fread(ini_buf, sizeof(char), INI_BUF_SIZE, ini_fp);
+  #else
+  UINT br = 0;
+  if (f_read(&ini_file, ini_buf, INI_BUF_SIZE, &br) != FR_OK) br = 0;
+  ini_buf_len = br;
+  #endif
+  return ini_buf_len;
+}
+
+
+//// ini_reload() ////
+#ifndef INI_PARSER_TEST
+// read the current chunk again, for handlers which used sector_buffer
+void ini_reload()
 {
   UINT br;
-  if (!(ini_pt&0x1ff)) {
-    // reload buffer
+  f_lseek(&ini_file, ini_buf_pos);
+  f_read(&ini_file, ini_buf, ini_buf_len, &br);
+}
+#endif
+
+
+//// ini_getch() ////
+static inline char ini_getch()
+{
+  if ((ini_pt - ini_buf_pos >= ini_buf_len) && !ini_read_chunk()) return 0;
+  return ini_buf[(ini_pt++) - ini_buf_pos];
+}
+
+
+//// ini_write() ////
+static void ini_write(const char* buf, int len)
+{
+  #ifdef INI_PARSER_TEST
+  fwrite(buf, sizeof(char), len, ini_fp);
+  #else
+  UINT bw;
+  f_write(&ini_file, buf, len, &bw);
+  #endif
+}
+
+
+//// ini_flush() ////
+static void ini_flush()
+{
+  if (!ini_out_open) {
     #ifdef INI_PARSER_TEST
-    fread(sector_buffer, sizeof(char), INI_BUF_SIZE, ini_fp);
+    ini_out_open = (ini_fp = fopen(ini_out_name, "wb")) ? 1 : -1;
     #else
-    f_read(&ini_file, sector_buffer, 512, &br);
+    ini_out_open = f_open(&ini_file, ini_out_name, FA_WRITE | FA_CREATE_ALWAYS) == FR_OK ? 1 : -1;
     #endif
+    if (ini_out_open < 0) ini_parser_debugf("Can't open file %s !", ini_out_name);
   }
 
-  #ifdef INI_PARSER_TEST
-  if (ini_pt >= ini_size) return 0;
-  #else
-  if (ini_pt >= f_size(&ini_file)) return 0;
-  #endif
-  else return sector_buffer[(ini_pt++)&0x1ff];
+  if (ini_out_open > 0 && ini_pt) ini_write(ini_buf, ini_pt);
+  ini_out_pos += ini_pt;
+  ini_pt = 0;
 }
 
 
 //// ini_putch() ////
 static void ini_putch(char c)
 {
-  UINT bw;
+  ini_buf[ini_pt++] = c;
+  if (ini_pt == INI_BUF_SIZE) ini_flush();
+}
 
-  sector_buffer[ini_pt++] = c;
 
-  if (!(ini_pt%0x1ff)) {
-    // write buffer
-    ini_pt = 0;
-    #ifdef INI_PARSER_TEST
-    fwrite(sector_buffer, sizeof(char), INI_BUF_SIZE, ini_fp);
-    #else
-    f_write(&ini_file, sector_buffer, INI_BUF_SIZE, &bw);
-    #endif
+//// ini_hash() ////
+#define INI_HASH_INIT 2166136261u
+
+static inline uint32_t ini_hash(uint32_t h, char c)
+{
+  return (h ^ (uint8_t)c) * 16777619u;
+}
+
+static uint32_t ini_hash_str(const char* s)
+{
+  uint32_t h = INI_HASH_INIT;
+  while (*s) h = ini_hash(h, *s++);
+  return h;
+}
+
+
+//// ini_layout_add() ////
+static void ini_layout_add(ini_layout_t* layout, int* cnt, int var, int pos, int len, uint32_t sum)
+{
+  if (*cnt < 0) return;
+  if (*cnt == INI_LAYOUT_SIZE || var > 0xff || pos > 0xffff || len > 0xff) {
+    *cnt = -1;
+    return;
   }
+  layout[*cnt].pos = pos;
+  layout[*cnt].len = len;
+  layout[*cnt].var = var;
+  layout[*cnt].sum = sum;
+  (*cnt)++;
 }
 
 
@@ -118,14 +224,31 @@ static int ini_getline(char* line)
   char c;
   char ignore=0;
   char literal=0;
+  char keep;
   int i=0;
+  uint32_t sum = INI_HASH_INIT;
 
+  ini_val_pos = -1;
   while(1) {
     c = ini_getch();
     if ((!c) || CHAR_IS_LINEEND(c)) break;
-    else if (CHAR_IS_QUOTE(c) && !ignore) literal ^= 1;
-    else if (CHAR_IS_COMMENT(c) && !ignore && !literal) ignore++;
+    keep = 1;
+    if (CHAR_IS_QUOTE(c) && !ignore) literal ^= 1;
+    else if (CHAR_IS_COMMENT(c) && !ignore && !literal) ignore++, keep = 0;
     else if ((literal || (CHAR_IS_VALID(c) && !ignore)) && i<(INI_LINE_SIZE-1)) line[i++] = c;
+    else keep = 0;
+
+    // the value spans from the first '=' to the last char kept
+    if (ini_val_pos >= 0) {
+      sum = ini_hash(sum, c);
+      if (keep) {
+        ini_val_end = ini_pt;
+        ini_val_sum = sum;
+      }
+    } else if (keep && c == '=') {
+      ini_val_pos = ini_val_end = ini_pt;
+      ini_val_sum = INI_HASH_INIT;
+    }
   }
   line[i] = '\0';
   return c==0 ? INI_EOT : literal ? 1 : 0;
@@ -188,18 +311,48 @@ static int ini_get_section(const ini_cfg_t* cfg, char* buf, const char* alter_se
 }
 
 
+//// ini_var_cmp() ////
+static int ini_var_cmp(const ini_var_t* var, int section, const char* name)
+{
+  if (var->section_id != section) return var->section_id < section ? -1 : 1;
+  return strcmp(var->name, name);
+}
+
+
+//// ini_find_var() ////
+static int ini_find_var(const ini_cfg_t* cfg, int section, const char* name)
+{
+  int lo=0, hi=cfg->nvars-1, mid, cmp;
+
+  if (!ini_vars_sorted) {
+    for (mid=0; mid<cfg->nvars; mid++)
+      if (!ini_var_cmp(&cfg->vars[mid], section, name)) return mid;
+    return -1;
+  }
+
+  while (lo <= hi) {
+    mid = (lo + hi) / 2;
+    cmp = ini_var_cmp(&cfg->vars[mid], section, name);
+    if (!cmp) return mid;
+    if (cmp < 0) lo = mid + 1;
+    else hi = mid - 1;
+  }
+  return -1;
+}
+
+
 //// ini_get_var() ////
-static void* ini_get_var(const ini_cfg_t* cfg, int cur_section, char* buf, int tag)
+static int ini_get_var(const ini_cfg_t* cfg, int cur_section, char* buf, int tag)
 {
   int i=0, j=0;
-  int var_id = -1;
+  int var_id;
 
   // find var
   while(1) {
     if (buf[i] == '=') {
       buf[i] = '\0';
       break;
-    } else if (buf[i] == '\0') return (void*)0;
+    } else if (buf[i] == '\0') return -1;
     i++;
   }
 
@@ -210,9 +363,7 @@ static void* ini_get_var(const ini_cfg_t* cfg, int cur_section, char* buf, int t
   }
 
   // parse var
-  for (j=0; j<cfg->nvars; j++) {
-    if ((!strcmp(buf, cfg->vars[j].name)) && (cfg->vars[j].section_id == cur_section)) var_id = j;
-  }
+  var_id = ini_find_var(cfg, cur_section, buf);
 
   // get data
   if (var_id != -1) {
@@ -273,10 +424,9 @@ static void* ini_get_var(const ini_cfg_t* cfg, int cur_section, char* buf, int t
         ((custom_handler_t*)(cfg->vars[var_id].var))(&(buf[i]), INI_LOAD, tag);
         break;
     }
-    return (void*)(&(cfg->vars[var_id].var));
   }
 
-  return (void*)0;
+  return var_id;
 }
 
 
@@ -286,6 +436,7 @@ void ini_parse(const ini_cfg_t* cfg, const char *alter_section, int tag)
   char line[INI_LINE_SIZE] = {0};
   int section = INI_SECTION_INVALID_ID;
   int line_status;
+  int i, var;
 
   if (alter_section)
     ini_parser_debugf("Start INI parser for core \"%s\".", alter_section);
@@ -300,20 +451,28 @@ void ini_parse(const ini_cfg_t* cfg, const char *alter_section, int tag)
     return;
   }
 
-  #ifdef INI_PARSER_TEST
-  // save size
-  fseek(ini_fp, 0L, SEEK_END);
-  ini_size = ftell(ini_fp);
-  fseek(ini_fp, 0L, SEEK_SET);
-  #endif
-
-  #ifdef INI_PARSER_TEST
-  ini_parser_debugf("Opened file %s with size %d bytes.", cfg->filename, ini_size);
-  #else
+  #ifndef INI_PARSER_TEST
   ini_parser_debugf("Opened file %s with size %llu bytes.", cfg->filename, f_size(&ini_file));
   #endif
 
+  // var tables sorted by section and name are searched binary,
+  // others linearly
+  ini_vars_sorted = 1;
+  for (i=1; i<cfg->nvars; i++) {
+    if (ini_var_cmp(&cfg->vars[i-1], cfg->vars[i].section_id, cfg->vars[i].name) >= 0) {
+      ini_parser_debugf("Vars of %s are not sorted, using linear search.", cfg->filename);
+      ini_vars_sorted = 0;
+      break;
+    }
+  }
+
   ini_pt = 0;
+  ini_buf_pos = 0;
+  ini_buf_len = 0;
+
+  ini_layout_cnt = 0;
+  ini_layout_vars = cfg->vars;
+  ini_layout_name = ini_hash_str(cfg->filename);
 
   // parse ini
   while (1) {
@@ -327,12 +486,14 @@ void ini_parse(const ini_cfg_t* cfg, const char *alter_section, int tag)
         section = ini_get_section(cfg, line, alter_section);
       } else {
         // otherwise this is a variable, get it
-        ini_get_var(cfg, section, line, tag);
+        var = ini_get_var(cfg, section, line, tag);
+        if (var >= 0) ini_layout_add(ini_layout, &ini_layout_cnt, var, ini_val_pos, ini_val_end - ini_val_pos, ini_val_sum);
       }
     }
     // if end of file, stop
     if (line_status == INI_EOT) break;
   }
+  ini_layout_size = ini_pt;
 
   #ifdef INI_PARSER_TEST
   // close file
@@ -343,23 +504,77 @@ void ini_parse(const ini_cfg_t* cfg, const char *alter_section, int tag)
 }
 
 
+//// ini_putvar() ////
+static void ini_putvar(ini_layout_t* layout, int* cnt, int var, char* name, char* val)
+{
+  ini_putline(name);
+  ini_putch('=');
+  ini_layout_add(layout, cnt, var, ini_out_pos + ini_pt, strlen(val), ini_hash_str(val));
+  ini_putline(val);
+  ini_putch('\n');
+}
+
+
+//// ini_patch() ////
+// write the changed values of a save into the existing file, the
+// rendered file must still be complete in ini_buf
+static char ini_patch(const ini_cfg_t* cfg, const ini_layout_t* layout, int cnt)
+{
+  int i, j, size;
+
+  if (cnt != ini_layout_cnt || cfg->vars != ini_layout_vars || ini_hash_str(cfg->filename) != ini_layout_name) return 0;
+  for (i=0; i<cnt; i++) {
+    if (layout[i].var != ini_layout[i].var || layout[i].len > ini_layout[i].len) return 0;
+  }
+
+  #ifdef INI_PARSER_TEST
+  if ((ini_fp = fopen(cfg->filename, "r+b")) == NULL) return 0;
+  fseek(ini_fp, 0, SEEK_END);
+  size = ftell(ini_fp);
+  #else
+  if (f_open(&ini_file, cfg->filename, FA_READ | FA_WRITE) != FR_OK) return 0;
+  size = f_size(&ini_file);
+  #endif
+
+  if (size == ini_layout_size) {
+    for (i=0; i<cnt; i++) {
+      if (layout[i].sum == ini_layout[i].sum) continue;
+      ini_parser_debugf("patching var %s", cfg->vars[layout[i].var].name);
+      #ifdef INI_PARSER_TEST
+      fseek(ini_fp, ini_layout[i].pos, SEEK_SET);
+      #else
+      f_lseek(&ini_file, ini_layout[i].pos);
+      #endif
+      ini_write(&ini_buf[layout[i].pos], layout[i].len);
+      // blank the rest of a longer old value, the parser skips spaces
+      for (j=layout[i].len; j<ini_layout[i].len; j++) ini_write(" ", 1);
+      ini_layout[i].sum = layout[i].sum;
+    }
+  }
+
+  #ifdef INI_PARSER_TEST
+  fclose(ini_fp);
+  #else
+  f_close(&ini_file);
+  #endif
+
+  return size == ini_layout_size;
+}
+
+
 //// ini_save() ////
 void ini_save(const ini_cfg_t* cfg, int tag)
 {
   int section, var;
   char line[INI_LINE_SIZE] = {0};
   char val[INI_LINE_SIZE] = {0};
+  ini_layout_t layout[INI_LAYOUT_SIZE];
+  int cnt = 0;
 
   ini_pt = 0;
-  // open ini file
-  #ifdef INI_PARSER_TEST
-  if ((ini_fp = fopen(cfg->filename, "wb")) == NULL) {
-  #else
-  if (f_open(&ini_file, cfg->filename, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
-  #endif
-    ini_parser_debugf("Can't open file %s !", cfg->filename);
-    return;
-  }
+  ini_out_name = cfg->filename;
+  ini_out_pos = 0;
+  ini_out_open = 0;
 
   // loop over sections
   for (section=0; section<cfg->nsections; section++) {
@@ -373,55 +588,55 @@ void ini_save(const ini_cfg_t* cfg, int tag)
         ini_parser_debugf("writing var %s", cfg->vars[var].name);
         switch (cfg->vars[var].type) {
           case UINT8:
-            siprintf(line, "%s=%u\n", cfg->vars[var].name, *(uint8_t*)(cfg->vars[var].var));
+            siprintf(line, "%u", *(uint8_t*)(cfg->vars[var].var));
             break;
           case UINT16:
-            siprintf(line, "%s=%u\n", cfg->vars[var].name, *(uint16_t*)(cfg->vars[var].var));
+            siprintf(line, "%u", *(uint16_t*)(cfg->vars[var].var));
             break;
           case UINT32:
-            siprintf(line, "%s=0x%x\n", cfg->vars[var].name, *(uint32_t*)(cfg->vars[var].var));
+            siprintf(line, "0x%x", *(uint32_t*)(cfg->vars[var].var));
             break;
           case UINT64:
-            siprintf(line, "%s=0x%llx\n", cfg->vars[var].name, *(uint64_t*)(cfg->vars[var].var));
+            siprintf(line, "0x%llx", *(uint64_t*)(cfg->vars[var].var));
             break;
           case INT8:
-            siprintf(line, "%s=%d\n", cfg->vars[var].name, *(int8_t*)(cfg->vars[var].var));
+            siprintf(line, "%d", *(int8_t*)(cfg->vars[var].var));
             break;
           case INT16:
-            siprintf(line, "%s=%d\n", cfg->vars[var].name, *(int16_t*)(cfg->vars[var].var));
+            siprintf(line, "%d", *(int16_t*)(cfg->vars[var].var));
             break;
           case INT32:
-            siprintf(line, "%s=0x%x\n", cfg->vars[var].name, *(int32_t*)(cfg->vars[var].var));
+            siprintf(line, "0x%x", *(int32_t*)(cfg->vars[var].var));
             break;
           #ifdef INI_ENABLE_FLOAT
           case FLOAT:
-            siprintf(line, "%s=%f\n", cfg->vars[var].name, *(float*)(cfg->vars[var].var));
+            siprintf(line, "%f", *(float*)(cfg->vars[var].var));
             break;
           #endif
           case STRING:
-            siprintf(line, "%s=\"%s\"\n", cfg->vars[var].name, (char*)(cfg->vars[var].var));
+            siprintf(line, "\"%s\"", (char*)(cfg->vars[var].var));
             break;
           case CUSTOM_HANDLER:
             while (((custom_handler_t*)(cfg->vars[var].var))(val, INI_SAVE, tag)) {
-                siprintf(line, "%s=\"%s\"\n", cfg->vars[var].name, val);
-                ini_putline(line);
+                siprintf(line, "\"%s\"", val);
+                ini_putvar(layout, &cnt, var, cfg->vars[var].name, line);
             };
         }
         if (cfg->vars[var].type != CUSTOM_HANDLER)
-            ini_putline(line);
+            ini_putvar(layout, &cnt, var, cfg->vars[var].name, line);
       }
     }
 
   }
 
-  // in case the buffer is not written yet, write it now
-  if (ini_pt) {
-    #ifdef INI_PARSER_TEST
-    fwrite(sector_buffer, sizeof(char), ini_pt, ini_fp);
-    #else
-    UINT bw;
-    f_write(&ini_file, sector_buffer, ini_pt, &bw);
-    #endif
+  // same lines as the file on disk, only patch the changed values
+  if (!ini_out_open && cnt >= 0 && ini_patch(cfg, layout, cnt)) return;
+
+  // otherwise write the whole file
+  ini_flush();
+  if (ini_out_open < 0) {
+    ini_layout_cnt = -1;
+    return;
   }
 
   #ifdef INI_PARSER_TEST
@@ -430,4 +645,9 @@ void ini_save(const ini_cfg_t* cfg, int tag)
   f_close(&ini_file);
   #endif
 
+  memcpy(ini_layout, layout, sizeof(ini_layout));
+  ini_layout_cnt = cnt;
+  ini_layout_vars = cfg->vars;
+  ini_layout_name = ini_hash_str(cfg->filename);
+  ini_layout_size = ini_out_pos;
 }
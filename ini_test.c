@@ -1,6 +1,8 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <time.h>
 
 #include "mist_cfg.h"
 
@@ -11,10 +13,107 @@ void siprintf(char *str, const char *format, ...) {
     va_end(arg);
 }
 
-int main() {
+// in-place save check: a shorter value is patched into the file and padded
+// with spaces, a longer one or a different set of lines rewrites the file
+#define SAVE_TEST_FILE "initest.ini"
+
+static uint8_t save_num;
+static char save_name[32];
+
+static const ini_section_t save_sections[] = {
+    {1, "TEST"}
+};
+
+static const ini_var_t save_vars[] = {
+    {"NUM",  (void*)&save_num, UINT8, 0, 255, 1},
+    {"NAME", (void*)save_name, STRING, 1, 31, 1}
+};
+
+static ini_cfg_t save_cfg = {
+    SAVE_TEST_FILE, save_sections, save_vars, 1, 2
+};
+
+static long save_test_size() {
+    long size;
+    FILE *f = fopen(SAVE_TEST_FILE, "rb");
+
+    if (!f) return -1;
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+// saves the values and parses them back, size is the expected file size
+// or 0 if it has to change
+static int save_test_step(const char *step, int num, const char *name, long size) {
+    long old_size = save_test_size();
+    long new_size;
+
+    save_num = num;
+    strcpy(save_name, name);
+    ini_save(&save_cfg, 0);
+    new_size = save_test_size();
+
+    save_num = 0;
+    save_name[0] = 0;
+    ini_parse(&save_cfg, 0, 0);
+
+    if (save_num != num || strcmp(save_name, name) ||
+        (size ? new_size != size : new_size == old_size)) {
+        printf("%s: FAILED (%d \"%s\", %ld bytes)\n", step, save_num, save_name, new_size);
+        return 1;
+    }
+    printf("%s: ok (%ld bytes)\n", step, new_size);
+    return 0;
+}
+
+static int save_test() {
+    int err = 0;
+    long size;
+
+    freopen("/dev/null", "w", stderr); // no parser debug output
+    remove(SAVE_TEST_FILE);
+    err |= save_test_step("initial save", 12, "longer name", 0);
+    size = save_test_size();
+    err |= save_test_step("shorter value patched", 3, "short", size);
+    err |= save_test_step("longer value rewritten", 200, "a much longer name", 0);
+    save_cfg.nvars = 1;
+    err |= save_test_step("fewer lines rewritten", 7, "", 0);
+    save_cfg.nvars = 2;
+    remove(SAVE_TEST_FILE);
+    return err;
+}
+
+// usage: initest [-t count [file]] [-s]
+//   -t: timing mode, parse test.ini (or file) count times and report the
+//       time per parse
+//   -s: check the in-place patching of ini_save()
+int main(int argc, char **argv) {
+    ini_cfg_t cfg = mist_ini_cfg;
+    struct timespec t0, t1;
+    int count = 0;
+
+    if (argc > 1 && !strcmp(argv[1], "-s"))
+        return save_test();
+
+    if (argc > 2 && !strcmp(argv[1], "-t")) {
+        count = atoi(argv[2]);
+        if (argc > 3) cfg.filename = argv[3];
+        freopen("/dev/null", "w", stderr); // no parser debug output
+    }
 
     memset(&mist_cfg, 0, sizeof(mist_cfg));
-    ini_parse(&mist_ini_cfg, "DEFENDER");
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < (count ? count : 1); i++)
+        ini_parse(&cfg, "DEFENDER", 0);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    if (count) {
+        double us = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / 1e3 / count;
+        printf("%d parses, %.2f us per parse\n", count, us);
+    }
+
     for (int i=0; i<5; i++) {
         printf("minimig cfg[%d] = %s\n", i, minimig_cfg.conf_name[i]);
     }
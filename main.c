@@ -97,7 +97,7 @@ void FatalError(unsigned long error) {
   }
 }
 
-void HandleFpga(void) {
+char HandleFpga(void) {
   unsigned char  c1, c2;
   
   EnableFpga();
@@ -113,6 +113,127 @@ void HandleFpga(void) {
   HandleHDD(c1, c2, 1);
   
   UpdateDriveStatus();
+
+  return (c1 & (CMD_RDTRK | CMD_WRTRK | CMD_IDECMD | CMD_IDEDAT)) ? 1 : 0;
+}
+
+// the core is considered streaming for this long after a served request
+#define STORAGE_ACTIVE_TIME 10
+#define TASK_REPORT_TIME    2000
+
+static unsigned long storage_active;
+static char storage_streaming = 0;
+static fpga_req_poll_t fpga_req_poll;
+
+// disk and CD requests of the core, serviced between all other tasks
+static void HandleStorage(void) {
+  char busy = user_io_poll_storage();
+
+  // call original minimig handlers if minimig core is found
+  if(((user_io_core_type() == CORE_TYPE_MINIMIG) ||
+      (user_io_core_type() == CORE_TYPE_MINIMIG2)) &&
+     user_io_req_poll_due(&fpga_req_poll)) {
+    char req = HandleFpga();
+    user_io_req_poll_done(&fpga_req_poll, req);
+    busy |= req;
+  }
+
+  if(busy) {
+    storage_active = GetTimer(STORAGE_ACTIVE_TIME);
+    storage_streaming = 1;
+  } else if(storage_streaming && CheckTimer(storage_active))
+    storage_streaming = 0;
+}
+
+static void HandleCoreUI(void) {
+  char mmc_ok = fat_medium_present();
+
+  // MIST (atari) core supports the same UI as Minimig
+  if((user_io_core_type() == CORE_TYPE_MIST) ||
+     (user_io_core_type() == CORE_TYPE_MIST2)) {
+     if(!mmc_ok)
+         tos_eject_all();
+
+     HandleUI();
+  }
+
+  if((user_io_core_type() == CORE_TYPE_MINIMIG) ||
+    (user_io_core_type() == CORE_TYPE_MINIMIG2)) {
+    if(!mmc_ok)
+        EjectAllFloppies();
+
+    HandleUI();
+  }
+
+  // 8 bit cores can also have a ui if a valid config string can be read from it
+  if((user_io_core_type() == CORE_TYPE_8BIT) && 
+     user_io_is_8bit_with_config_string())
+    HandleUI();
+
+  // Archie core will get its own treatment one day ...
+  if(user_io_core_type() == CORE_TYPE_ARCHIE)
+    HandleUI();
+}
+
+static void HandleEth(void) {
+  eth_poll();
+}
+
+// main loop tasks. HandleStorage() runs before each of them, so a slow
+// task (USB enumeration, OSD redraw) delays a disk or CD request by its
+// own run time only, not by a whole pass of the loop. While the core is
+// streaming data, a task with a deadline is deferred until its deadline
+// has passed since its last run.
+typedef struct {
+  void (*poll)(void);
+  const char *name;
+  unsigned short deadline;  // ms, 0: run on every pass
+  unsigned short budget;    // ms a run may take before it is reported
+} task_t;
+
+static const task_t tasks[] = {
+  { HandleStorage,        "storage", 0,  5 },  // must be the first
+  { cdc_control_poll,     "cdc",     10, 5 },
+  { storage_control_poll, "usbstor", 10, 20 },
+  { user_io_poll,         "user_io", 5,  5 },
+  { usb_poll,             "usb",     10, 20 },
+  { HandleEth,            "eth",     5,  5 },
+  { HandleCoreUI,         "ui",      20, 50 },
+};
+
+#define TASKS (sizeof(tasks)/sizeof(task_t))
+
+static struct {
+  unsigned long due;
+  unsigned short max;       // longest run, ms
+  unsigned short overruns;  // runs over budget
+} task_stat[TASKS];
+
+static void RunTask(int i) {
+  unsigned long t = GetRTTC();
+
+  tasks[i].poll();
+
+  t = GetRTTC() - t;
+  if(t > task_stat[i].max) task_stat[i].max = t;
+  if(t > tasks[i].budget) task_stat[i].overruns++;
+  task_stat[i].due = GetTimer(tasks[i].deadline);
+}
+
+// with the debug switch set, report the task run times
+static void TaskReport(void) {
+  static unsigned long timer = 0;
+  int i;
+
+  if(timer && !CheckTimer(timer)) return;
+  timer = GetTimer(TASK_REPORT_TIME);
+  if(!user_io_dip_switch1()) return;
+
+  for(i=0; i<TASKS; i++) {
+    iprintf("task %-8s max %3u ms, %u runs over %u ms\n", tasks[i].name,
+            task_stat[i].max, task_stat[i].overruns, tasks[i].budget);
+    task_stat[i].max = task_stat[i].overruns = 0;
+  }
 }
 
 extern void inserttestfloppy();
@@ -241,44 +362,17 @@ int main(void)
     usb_dev_open();
 
     while (1) {
-      mmc_ok = fat_medium_present();
-
-      cdc_control_poll();
-      storage_control_poll();
+      int i;
 
-      user_io_poll();
+      for(i=1; i<TASKS; i++) {
+        RunTask(0);
 
-      usb_poll();
-
-      eth_poll();
-
-      // MIST (atari) core supports the same UI as Minimig
-      if((user_io_core_type() == CORE_TYPE_MIST) ||
-         (user_io_core_type() == CORE_TYPE_MIST2)) {
-         if(!mmc_ok)
-             tos_eject_all();
-
-         HandleUI();
-      }
-
-      // call original minimig handlers if minimig core is found
-      if((user_io_core_type() == CORE_TYPE_MINIMIG) ||
-        (user_io_core_type() == CORE_TYPE_MINIMIG2)) {
-        if(!mmc_ok)
-            EjectAllFloppies();
-
-        HandleFpga();
-        HandleUI();
+        // defer housekeeping while the core streams data
+        if(!tasks[i].deadline || !storage_streaming || CheckTimer(task_stat[i].due))
+          RunTask(i);
       }
 
-      // 8 bit cores can also have a ui if a valid config string can be read from it
-      if((user_io_core_type() == CORE_TYPE_8BIT) && 
-	 user_io_is_8bit_with_config_string())
-	HandleUI();
-
-      // Archie core will get its own treatment one day ...
-      if(user_io_core_type() == CORE_TYPE_ARCHIE)
-	HandleUI();
+      TaskReport();
     }
     return 0;
 }
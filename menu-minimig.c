@@ -87,6 +87,8 @@ static void InsertFloppy(adfTYPE *drive, const unsigned char *name)
 	unsigned long tracks;
 	FRESULT res;
 
+	// write back pending sectors before the drive's file is reopened
+	FlushTrackCache();
 	if ((res = f_open(&drive->file, name, FA_READ | FA_WRITE)) != FR_OK) {
 		iprintf("Disk open failed (%d), trying read only mode\n", res);
 		readonly = true;
@@ -611,6 +613,7 @@ static char GetMenuItem_Minimig(uint8_t idx, char action, menu_item_t *item) {
 				case 1:
 				case 2:
 				case 3:
+					FlushTrackCache();
 					if (df[idx].status & DSK_INSERTED) {// eject selected floppy
 						df[idx].status = 0;
 					} else {
@@ -868,6 +871,7 @@ static char GetMenuItem_Minimig(uint8_t idx, char action, menu_item_t *item) {
 			break;
 		case MENU_ACT_BKSP:
 			if (page_idx == 0) { // eject all floppies
+				FlushTrackCache();
 				for (int i = 0; i <= drives; i++)
 					df[i].status = 0;
 			}
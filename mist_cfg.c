@@ -12,17 +12,14 @@
 #include "usb/hid.h"
 #include "usb/joymapping.h"
 
-extern FIL ini_file;
-
-// call data_io_rom_upload but reload sector_buffer afterwards since the io
-// operations in data_io_rom_upload may have overwritten the buffer
+// call data_io_rom_upload but reload the ini parser buffer afterwards since
+// the io operations in data_io_rom_upload may have overwritten sector_buffer
 // mode = 0: prepare for rom upload, mode = 1: rom upload, mode = 2, end rom upload
 char ini_rom_upload(char *s, char action, int tag) {
   if(action == INI_SAVE) return 0;
 #ifndef INI_PARSER_TEST
   data_io_rom_upload(s, 1);
-  f_lseek(&ini_file, (((f_tell(&ini_file)+511)>>9)-1)<<9);
-  FileReadBlock(&ini_file, sector_buffer);
+  ini_reload();
 #endif
   return 0;
 }
@@ -89,57 +86,63 @@ const ini_section_t mist_ini_sections[] = {
   {3, "ATARIST_CONFIG"}
 };
 
-// mist ini vars
+// mist ini vars, sorted by section and name (see ini_parser.c)
 const ini_var_t mist_ini_vars[] = {
   // [MIST] or [<core name>]
-  {"LED_ANIMATION", (void*)(&(mist_cfg.led_animation)), UINT8, 0, 1, 1},
-  {"YPBPR", (void*)(&(mist_cfg.ypbpr)), UINT8, 0, 1, 1},
-  {"KEEP_VIDEO_MODE", (void*)(&(mist_cfg.keep_video_mode)), UINT8, 0, 1, 1},
-  {"KEYRAH_MODE", (void*)(&(mist_cfg.keyrah_mode)), UINT32, 0, 0xFFFFFFFF, 1},
-  {"RESET_COMBO", (void*)(&(mist_cfg.reset_combo)), UINT8, 0, 2, 1},
-  {"SCANDOUBLER_DISABLE", (void*)(&(mist_cfg.scandoubler_disable)), UINT8, 0, 1, 1},
+  {"AMIGA_MOD_KEYS", (void*)(&(mist_cfg.amiga_mod_keys)), UINT8, 0, 3, 1},
   {"CSYNC_DISABLE", (void*)(&(mist_cfg.csync_disable)), UINT8, 0, 1, 1},
-  {"MOUSE_BOOT_MODE", (void*)(&(mist_cfg.mouse_boot_mode)), UINT8, 0, 1, 1},
-  {"MOUSE_SPEED", (void*)(&(mist_cfg.mouse_speed)), UINT8, 10, 200, 1},
-  {"JOYSTICK_IGNORE_HAT", (void*)(&(mist_cfg.joystick_ignore_hat)), UINT8, 0, 1, 1},
-  {"JOYSTICK_DISABLE_SHORTCUTS", (void*)(&(mist_cfg.joystick_disable_shortcuts)), UINT8, 0, 1, 1},
-  {"JOYSTICK_IGNORE_OSD", (void*)(&(mist_cfg.joystick_ignore_osd)), UINT8, 0, 1, 1},
+#ifndef INI_PARSER_TEST
+  {"HID_BUTTON_REMAP", (void*)hid_joystick_button_remap, CUSTOM_HANDLER, 0, 0, 1},
+#endif
+  {"INDEX_CACHE", (void*)(&(mist_cfg.index_cache)), UINT8, 0, 1, 1},
   {"JOYSTICK0_PREFER_DB9", (void*)(&(mist_cfg.joystick0_prefer_db9)), UINT8, 0, 1, 1},
-  {"JOYSTICK_DB9_FIXED_INDEX", (void*)(&(mist_cfg.joystick_db9_fixed_index)), UINT8, 0, 1, 1},
-  {"JOYSTICK_EMU_FIXED_INDEX", (void*)(&(mist_cfg.joystick_emu_fixed_index)), UINT8, 0, 1, 1},
   {"JOYSTICK_ANALOG_MULTIPLIER", (void*)(&(mist_cfg.joystick_analog_mult)), UINT8, 1, 128, 1},
   {"JOYSTICK_ANALOG_OFFSET", (void*)(&(mist_cfg.joystick_analog_offset)), INT8, -127, 127, 1},
   {"JOYSTICK_AUTOFIRE_COMBO", (void*)(&(mist_cfg.joystick_autofire_combo)), INT8, 0, 2, 1},
-  {"JOYSTICK_DISABLE_SWAP", (void*)(&(mist_cfg.joystick_disable_swap)), INT8, 0, 1, 1},
-  {"JOYSTICK_DEAD_RANGE", (void*)(&(mist_cfg.joystick_dead_range)), UINT8, 0, 255, 1},
-  {"KEY_MENU_AS_RGUI", (void*)(&(mist_cfg.key_menu_as_rgui)), UINT8, 0, 1, 1},
-  {"SDRAM64", (void*)(&(mist_cfg.sdram64)), UINT8, 0, 1, 1},
+  {"JOYSTICK_DB9_FIXED_INDEX", (void*)(&(mist_cfg.joystick_db9_fixed_index)), UINT8, 0, 1, 1},
 #ifdef JOY_DB9_MD
   {"JOYSTICK_DB9_MD", (void*)(&(mist_cfg.joystick_db9_md)), UINT8, 0, 2, 1},
 #endif
+  {"JOYSTICK_DEAD_RANGE", (void*)(&(mist_cfg.joystick_dead_range)), UINT8, 0, 255, 1},
+  {"JOYSTICK_DISABLE_SHORTCUTS", (void*)(&(mist_cfg.joystick_disable_shortcuts)), UINT8, 0, 1, 1},
+  {"JOYSTICK_DISABLE_SWAP", (void*)(&(mist_cfg.joystick_disable_swap)), INT8, 0, 1, 1},
+  {"JOYSTICK_EMU_FIXED_INDEX", (void*)(&(mist_cfg.joystick_emu_fixed_index)), UINT8, 0, 1, 1},
+  {"JOYSTICK_IGNORE_HAT", (void*)(&(mist_cfg.joystick_ignore_hat)), UINT8, 0, 1, 1},
+  {"JOYSTICK_IGNORE_OSD", (void*)(&(mist_cfg.joystick_ignore_osd)), UINT8, 0, 1, 1},
 #ifndef INI_PARSER_TEST
-  {"KEY_REMAP", (void*)user_io_key_remap, CUSTOM_HANDLER, 0, 0, 1},
-  {"HID_BUTTON_REMAP", (void*)hid_joystick_button_remap, CUSTOM_HANDLER, 0, 0, 1},
   {"JOYSTICK_REMAP", (void*)virtual_joystick_remap, CUSTOM_HANDLER, 0, 0, 1},
   {"JOY_KEY_MAP", (void*)joystick_key_map, CUSTOM_HANDLER, 0, 0, 1},
 #endif
+  {"KEEP_VIDEO_MODE", (void*)(&(mist_cfg.keep_video_mode)), UINT8, 0, 1, 1},
+  {"KEYRAH_MODE", (void*)(&(mist_cfg.keyrah_mode)), UINT32, 0, 0xFFFFFFFF, 1},
+  {"KEY_MENU_AS_RGUI", (void*)(&(mist_cfg.key_menu_as_rgui)), UINT8, 0, 1, 1},
+#ifndef INI_PARSER_TEST
+  {"KEY_REMAP", (void*)user_io_key_remap, CUSTOM_HANDLER, 0, 0, 1},
+#endif
+  {"LED_ANIMATION", (void*)(&(mist_cfg.led_animation)), UINT8, 0, 1, 1},
+  {"MOUSE_BOOT_MODE", (void*)(&(mist_cfg.mouse_boot_mode)), UINT8, 0, 1, 1},
+  {"MOUSE_SPEED", (void*)(&(mist_cfg.mouse_speed)), UINT8, 10, 200, 1},
+  {"RESET_COMBO", (void*)(&(mist_cfg.reset_combo)), UINT8, 0, 2, 1},
   {"ROM", (void*)ini_rom_upload, CUSTOM_HANDLER, 0, 0, 1},
-  {"AMIGA_MOD_KEYS", (void*)(&(mist_cfg.amiga_mod_keys)), UINT8, 0, 3, 1},
+  {"SCANDOUBLER_DISABLE", (void*)(&(mist_cfg.scandoubler_disable)), UINT8, 0, 1, 1},
+  {"SDRAM64", (void*)(&(mist_cfg.sdram64)), UINT8, 0, 1, 1},
+  {"SD_WRITE_BACK", (void*)(&(mist_cfg.sd_write_back)), UINT8, 0, 1, 1},
   {"USB_STORAGE", (void*)(&(mist_cfg.usb_storage)), UINT8, 0, 1, 1},
+  {"YPBPR", (void*)(&(mist_cfg.ypbpr)), UINT8, 0, 1, 1},
   // [MINIMIG_CONFIG]
-  {"KICK1X_MEMORY_DETECTION_PATCH", (void*)(&(minimig_cfg.kick1x_memory_detection_patch)), UINT8, 0, 1, 2},
   {"CLOCK_FREQ", (void*)(&(minimig_cfg.clock_freq)), UINT8, 0, 2, 2},
-  {"CONF_DEFAULT", (void*)(&(minimig_cfg.conf_name[0])), STRING, 1, 10, 2},
   {"CONF_1", (void*)(&(minimig_cfg.conf_name[1])), STRING, 1, 10, 2},
   {"CONF_2", (void*)(&(minimig_cfg.conf_name[2])), STRING, 1, 10, 2},
   {"CONF_3", (void*)(&(minimig_cfg.conf_name[3])), STRING, 1, 10, 2},
   {"CONF_4", (void*)(&(minimig_cfg.conf_name[4])), STRING, 1, 10, 2},
+  {"CONF_DEFAULT", (void*)(&(minimig_cfg.conf_name[0])), STRING, 1, 10, 2},
+  {"KICK1X_MEMORY_DETECTION_PATCH", (void*)(&(minimig_cfg.kick1x_memory_detection_patch)), UINT8, 0, 1, 2},
   // [ATARIST_CONFIG]
-  {"CONF_DEFAULT", (void*)(&(atarist_cfg.conf_name[0])), STRING, 1, 10, 3},
   {"CONF_1", (void*)(&(atarist_cfg.conf_name[1])), STRING, 1, 10, 3},
   {"CONF_2", (void*)(&(atarist_cfg.conf_name[2])), STRING, 1, 10, 3},
   {"CONF_3", (void*)(&(atarist_cfg.conf_name[3])), STRING, 1, 10, 3},
-  {"CONF_4", (void*)(&(atarist_cfg.conf_name[4])), STRING, 1, 10, 3}
+  {"CONF_4", (void*)(&(atarist_cfg.conf_name[4])), STRING, 1, 10, 3},
+  {"CONF_DEFAULT", (void*)(&(atarist_cfg.conf_name[0])), STRING, 1, 10, 3}
 };
 
 // mist ini config
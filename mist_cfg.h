@@ -41,6 +41,8 @@ typedef struct {
   uint8_t sdram64;
   uint8_t amiga_mod_keys;
   uint8_t usb_storage;
+  uint8_t sd_write_back;
+  uint8_t index_cache;
 } mist_cfg_t;
 
 
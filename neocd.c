@@ -81,7 +81,7 @@ static void SendData(char *buf, uint16_t len, unsigned char dm) {
 }
 
 static void SeekToLBA(int lba, int play) {
-	int index = 0;
+	int index;
 
 	neocdd.latency = 0;
 	if (play)
@@ -93,17 +93,10 @@ static void SeekToLBA(int lba, int play) {
 
 	neocdd.lba = lba;
 
-	while ((toc.tracks[index].end <= lba) && (index < toc.last)) index++;
+	index = cue_gettrackbylba(lba);
 	neocdd.index = index;
 
-	if (lba < toc.tracks[index].start)
-	{
-		lba = toc.tracks[index].start;
-	}
-
-	int offset = (lba - toc.tracks[index].start) * toc.tracks[index].sector_size + toc.tracks[index].offset;
-	f_lseek(&toc.file->file, offset);
-	neocd_debugf("SeekToLBA lba=%lu offset=%08x", lba, offset);
+	neocd_debugf("SeekToLBA lba=%lu index=%d", lba, index);
 	if (play)
 	{
 		neocdd.audioOffset = 0;
@@ -113,15 +106,14 @@ static void SeekToLBA(int lba, int play) {
 static int SectorSend(uint8_t* header)
 {
 	int len = 2352;
-	UINT br;
 	if (header) {
 		memcpy(sector_buffer + 12, header, 4);
 	}
 	DISKLED_ON
 	if (toc.tracks[neocdd.index].sector_size == 2048)
-		f_read(&toc.file->file, sector_buffer+16, 2048, &br);
+		cue_readsector_ra(neocdd.lba, 0, sector_buffer+16, 2048);
 	else
-		f_read(&toc.file->file, sector_buffer, 2352, &br);
+		cue_readsector_ra(neocdd.lba, 0, sector_buffer, 2352);
 	DISKLED_OFF
 
 	SendData(sector_buffer, len, toc.tracks[neocdd.index].type);
@@ -175,9 +167,19 @@ static void neocd_reset() {
 
 static unsigned long neocd_read_timer = 0;
 
+// fill the read-ahead ring from the current position while the core has
+// no room for the next sector, or the drive is still seeking. At most as
+// many sectors as the drive speed per poll, to keep the poll loop short.
+static void Prefetch() {
+	if ((neocdd.status == CD_STAT_PLAY || neocdd.status == CD_STAT_SEEK || neocdd.status == CD_STAT_PAUSE) &&
+	    user_io_is_cue_mounted() && neocdd.index < toc.last)
+		cue_readahead(neocdd.lba, neocdd.speed);
+}
+
 static void neocd_run() {
 
 	if (neocdd.latency > 0) {
+		Prefetch();
 		if(!CheckTimer(neocd_read_timer)) return;
 		neocd_read_timer = GetTimer(10);
 		neocdd.latency--;
@@ -207,6 +209,7 @@ static void neocd_run() {
 
 		if (!((!toc.tracks[neocdd.index].type && neocdd.cdda_fifo_halffull) ||
 		      ( toc.tracks[neocdd.index].type && neocdd.can_read_next))) {
+			Prefetch();
 			return; // not enough space in FPGA FIFO yet
 		}
 		if (toc.tracks[neocdd.index].type)
@@ -236,7 +239,6 @@ static void neocd_run() {
 		{
 			neocdd.index++;
 			neocdd.isData = 0x01;
-			f_lseek(&toc.file->file, toc.tracks[neocdd.index].offset);
 		}
 	}
 	else if (neocdd.status == CD_STAT_SCAN) {
@@ -271,8 +273,6 @@ static void neocd_run() {
 		}
 
 		neocdd.isData = toc.tracks[neocdd.index].type;
-		int offset = (neocdd.lba - toc.tracks[neocdd.index].start) * toc.tracks[neocdd.index].sector_size + toc.tracks[neocdd.index].offset;
-		f_lseek(&toc.file->file, offset);
 	}
 }
 
@@ -651,7 +651,8 @@ static void neocd_sendstatus() {
 
 static unsigned long neocd_timer = 0;
 
-void neocd_poll() {
+// returns 1 if the core sent a request or the disc is playing
+char neocd_poll() {
 	char c;
 	EnableFpga();
 	c = SPI(CD_STAT_GET); // cmd request
@@ -662,7 +663,7 @@ void neocd_poll() {
 
 	if (c & 0x20) {
 		neocd_reset();
-		return;
+		return 1;
 	}
 
 	if (c&0x04) {
@@ -678,4 +679,6 @@ void neocd_poll() {
 			neocd_sendstatus();
 		}
 	}
+
+	return (c & 0x04) || neocdd.status == CD_STAT_PLAY;
 }
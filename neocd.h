@@ -1,6 +1,6 @@
 #ifndef _NEOCD_H_
 #define _NEOCD_H_
 
-void neocd_poll();
+char neocd_poll();
 
 #endif
\ No newline at end of file
@@ -136,25 +136,16 @@ static void SendData(char *buf, uint16_t len, unsigned char dm) {
 }
 
 static void SendSector(uint16_t len, unsigned char dm) {
-	UINT br;
 	DISKLED_ON;
 	if (toc.tracks[pcecdd.index].type && (pcecdd.lba >= 0)) {
 		// data sector
-
-		if (toc.tracks[pcecdd.index].sector_size != 2048)
-			f_lseek(&toc.file->file, f_tell(&toc.file->file) + 16);
-
-		pcecd_debugf("Send data sector, lba: %d pos: %llu", pcecdd.lba, f_tell(&toc.file->file));
-		f_read(&toc.file->file, sector_buffer, 2048, &br);
-
-		if (toc.tracks[pcecdd.index].sector_size != 2048)
-			f_lseek(&toc.file->file, f_tell(&toc.file->file) + (toc.tracks[pcecdd.index].sector_size - 2048 - 16));
-		//pcecd_debugf("Send data sector, post pos: %llu", f_tell(&toc.file->file));
+		pcecd_debugf("Send data sector, lba: %d", pcecdd.lba);
+		cue_readsector_ra(pcecdd.lba, (toc.tracks[pcecdd.index].sector_size != 2048) ? 16 : 0, sector_buffer, 2048);
 
 		SendData(sector_buffer, 2048, dm);
 		//hexdump(buffer, 2048, 0);
 	} else {
-		f_read(&toc.file->file, sector_buffer, 2352, &br);
+		cue_readsector_ra(pcecdd.lba, 0, sector_buffer, 2352);
 		SendData(sector_buffer, 2352, dm);
 	}
 	DISKLED_OFF;
@@ -225,7 +216,6 @@ static void pcecd_run() {
 		if (pcecdd.lba >=toc.tracks[pcecdd.index].end) {
 			pcecdd.index++;
 			pcecdd.isData = 0x01;
-			f_lseek(&toc.file->file, toc.tracks[pcecdd.index].offset);
 		}
 	} else if (pcecdd.state == PCECD_STATE_PLAY) {
 
@@ -256,8 +246,7 @@ static void pcecd_run() {
 		} else if (!pcecdd.cdda_fifo_halffull) {
 			for (int i = 0; i <= pcecdd.CDDAFirst; i++) {
 				if (!toc.tracks[pcecdd.index].type) {
-					f_lseek(&toc.file->file, toc.tracks[pcecdd.index].offset + (pcecdd.lba - toc.tracks[pcecdd.index].start) * 2352);
-					//pcecd_debugf("Audio sector send = %i, track = %i, offset = %llu", pcecdd.lba, pcecdd.index, f_tell(&toc.file->file));
+					//pcecd_debugf("Audio sector send = %i, track = %i", pcecdd.lba, pcecdd.index);
 					SendSector(2352, 0);
 				}
 				pcecdd.lba++;
@@ -393,10 +382,7 @@ static void pcecd_command() {
 		pcecdd.lba = new_lba;
 		pcecdd.cnt = cnt_;
 
-		int offset = (new_lba - toc.tracks[pcecdd.index].start) * toc.tracks[pcecdd.index].sector_size + toc.tracks[pcecdd.index].offset;
-		f_lseek(&toc.file->file, offset);
-
-		pcecd_debugf("lba: %d index: %d, offset: %d", new_lba, pcecdd.index, offset);
+		pcecd_debugf("lba: %d index: %d", new_lba, pcecdd.index);
 
 		pcecdd.audioOffset = 0;
 
@@ -611,7 +597,8 @@ static void pcecd_reset() {
 
 static unsigned long pcecd_timer = 0;
 
-void pcecd_poll() {
+// returns 1 if the core sent a request or a data track is being read
+char pcecd_poll() {
 	char c;
 	EnableFpga();
 	c = SPI(CD_STAT_GET); // cmd request
@@ -645,4 +632,6 @@ void pcecd_poll() {
 			pcecdd.data_req = 0;
 		}
 	}
+
+	return (c & 0x0f) || pcecdd.state == PCECD_STATE_READ;
 }
@@ -1,6 +1,6 @@
 #ifndef _PCECD_H_
 #define _PCECD_H_
 
-void pcecd_poll();
+char pcecd_poll();
 
 #endif
\ No newline at end of file
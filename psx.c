@@ -80,22 +80,19 @@ static uint16_t psx_libCryptMask(FIL* sbi_file)
 
 static void psx_read_sector(char* buffer, unsigned int lba)
 {
-	UINT br;
 	if (!toc.valid) {
 		memset(buffer, 0, 2352);
 		return;
 	}
 
 	int index = cue_gettrackbylba(lba);
-	int offset = (lba - toc.tracks[index].start) * toc.tracks[index].sector_size + toc.tracks[index].offset;
-	//psx_debugf("read CD lba=%d, track=%d offset=%d (trackstart=%d tracoffset=%d tracksectorsize=%d)", lba, index, offset, toc.tracks[index].start, toc.tracks[index].offset, toc.tracks[index].sector_size);
+	//psx_debugf("read CD lba=%d, track=%d (trackstart=%d tracoffset=%d tracksectorsize=%d)", lba, index, toc.tracks[index].start, toc.tracks[index].offset, toc.tracks[index].sector_size);
 	if (toc.tracks[index].sector_size != 2352) {
 		// unsupported sector size by the core
 		memset(buffer, 0, 2352);
 	} else {
 		DISKLED_ON
-		f_lseek(&toc.file->file, offset);
-		f_read(&toc.file->file, buffer, 2352, &br);
+		cue_readsector_ra(lba, 0, buffer, 2352);
 		DISKLED_OFF
 	}
 	return;
@@ -184,6 +181,8 @@ void psx_mount_cd(const unsigned char *name)
 	psx_send_cue_and_metadata(libcrypt_mask, region, 0);
 }
 
+static unsigned int psx_next_lba = 0;
+
 void psx_read_cd(uint8_t drive_index, unsigned int lba)
 {
 	user_io_sd_ack(drive_index);
@@ -192,4 +191,13 @@ void psx_read_cd(uint8_t drive_index, unsigned int lba)
 	spi_uio_cmd_cont(UIO_SECTOR_RD);
 	spi_write(sector_buffer, 2352);
 	DisableIO();
+
+	// a sequential stream (FMV, XA audio): refill the read-ahead ring while
+	// the core is busy with this sector, once it has run half empty
+	if (toc.valid && lba == psx_next_lba && cue_readahead_count(lba + 1) <= CUE_READAHEAD_SECTORS/2) {
+		DISKLED_ON
+		cue_readahead(lba + 1, CUE_READAHEAD_SECTORS);
+		DISKLED_OFF
+	}
+	psx_next_lba = lba + 1;
 }
@@ -30,14 +30,14 @@ const ini_section_t core_ini_sections[] = {
 	{1, "CFG"}
 };
 
-// core ini vars
+// core ini vars, sorted by section and name (see ini_parser.c)
 const ini_var_t core_ini_global_vars[] = {
 	{"JOYSTICK_REMAP", (void*)virtual_joystick_remap, CUSTOM_HANDLER, 0, 0, 1}
 };
 
 const ini_var_t core_ini_local_vars[] = {
-	{"STATUS", (void*)(&status), UINT64, 0, 0xFFFFFFFFFFFFFFFF, 1},
-	{"JOYSTICK_REMAP", (void*)virtual_joystick_remap, CUSTOM_HANDLER, 0, 0, 1}
+	{"JOYSTICK_REMAP", (void*)virtual_joystick_remap, CUSTOM_HANDLER, 0, 0, 1},
+	{"STATUS", (void*)(&status), UINT64, 0, 0xFFFFFFFFFFFFFFFF, 1}
 };
 
 static char settings_setup(ini_cfg_t *ini, char global) {
@@ -51,6 +51,16 @@ static struct {
   unsigned char spt;
 } fdd_image[2];
 
+#if FDC_TRACK_CACHE
+// whole floppy tracks read for the FDC
+static struct {
+  unsigned char drive;    // 0 - unused, 1/2 - drive A/B
+  unsigned int track;     // track * sides + side
+  char data[FDC_TRACK_SECTORS*512];
+} fdc_cache[FDC_TRACK_CACHE];
+static unsigned char fdc_cache_next;
+#endif
+
 unsigned long hdd_direct = 0;
 // 0-1 floppy, 2-3 hdd
 char disk_inserted[4];
@@ -180,6 +190,18 @@ static void mist_memory_read_block(char *data) {
   mist2_spi_set_speed(spi_speed);
 }
 
+static void mist_memory_read_blocks(char *data, int count) {
+  spi_speed = spi_get_speed();
+  mist2_spi_set_speed(spi_newspeed);
+  EnableFpga();
+  SPI(MIST_READ_MEMORY);
+
+  spi_read(data, 512*count);
+
+  DisableFpga();
+  mist2_spi_set_speed(spi_speed);
+}
+
 static void mist_memory_write_block(const char *data) {
   EnableFpga();
   SPI(MIST_WRITE_MEMORY);
@@ -266,7 +288,6 @@ static void handle_acsi(unsigned char *buffer) {
   unsigned short length = buffer[4];
 
   unsigned short blocklen;
-  unsigned char *buf;
   unsigned short blocks;
 
   if(length == 0) length = 256;
@@ -418,13 +439,9 @@ static void handle_acsi(unsigned char *buffer) {
           while(length) {
             UINT bw;
 
+            // fetch as many blocks from ST RAM as fit into the buffer in one burst
             blocklen = (length > SECTOR_BUFFER_SIZE/512) ? SECTOR_BUFFER_SIZE/512 : length;
-            buf = sector_buffer;
-            blocks = blocklen;
-            while (blocks--) {
-              mist_memory_read_block(buf);
-              buf+=512;
-            }
+            mist_memory_read_blocks(sector_buffer, blocklen);
             if(hdd_direct && target == 0) {
               if(user_io_dip_switch1()) 
                 tos_debugf("ACSI: direct write %ld", lba);
@@ -511,6 +528,61 @@ static void handle_acsi(unsigned char *buffer) {
   }
 }
 
+#if FDC_TRACK_CACHE
+// returns the cached data of a floppy sector, reading the whole track
+// with one multi-sector read if it's not cached yet
+static char *fdc_cache_sector(unsigned char drv, unsigned int offset) {
+  unsigned char spt = fdd_image[drv-1].spt;
+  unsigned int track;
+  int i;
+  UINT br = 0;
+
+  if(!spt || spt > FDC_TRACK_SECTORS) return 0;
+  track = offset / spt;
+
+  for(i=0;i<FDC_TRACK_CACHE;i++)
+    if(fdc_cache[i].drive == drv && fdc_cache[i].track == track)
+      return fdc_cache[i].data + 512*(offset % spt);
+
+  i = fdc_cache_next;
+  if(++fdc_cache_next == FDC_TRACK_CACHE) fdc_cache_next = 0;
+
+  f_lseek(&fdd_image[drv-1].file, track * spt * 512);
+  if(f_read(&fdd_image[drv-1].file, fdc_cache[i].data, spt * 512, &br) != FR_OK) {
+    fdc_cache[i].drive = 0;
+    return 0;
+  }
+  if(br < spt * 512) memset(fdc_cache[i].data + br, 0, spt * 512 - br);
+
+  fdc_cache[i].drive = drv;
+  fdc_cache[i].track = track;
+  return fdc_cache[i].data + 512*(offset % spt);
+}
+
+// keeps a cached track up to date when one of its sectors is written
+static void fdc_cache_write(unsigned char drv, unsigned int offset, const char *data) {
+  unsigned char spt = fdd_image[drv-1].spt;
+  int i;
+
+  if(!spt || spt > FDC_TRACK_SECTORS) return;
+
+  for(i=0;i<FDC_TRACK_CACHE;i++)
+    if(fdc_cache[i].drive == drv && fdc_cache[i].track == offset / spt)
+      memcpy(fdc_cache[i].data + 512*(offset % spt), data, 512);
+}
+
+static void fdc_cache_flush(unsigned char drv) {
+  int i;
+
+  for(i=0;i<FDC_TRACK_CACHE;i++)
+    if(fdc_cache[i].drive == drv) fdc_cache[i].drive = 0;
+}
+#else
+#define fdc_cache_sector(drv, offset) ((char*)0)
+#define fdc_cache_write(drv, offset, data)
+#define fdc_cache_flush(drv)
+#endif
+
 static void handle_fdc(unsigned char *buffer) {
   // extract contents
   unsigned int dma_address = 256 * 256 * buffer[0] + 
@@ -546,32 +618,43 @@ static void handle_fdc(unsigned char *buffer) {
       }
 
       while(scnt) {
+        unsigned char n = 1;
+
         // check if requested sector is in range
         if((fdc_sector > 0) && (fdc_sector <= fdd_image[drv_sel-1].spt)) {
+          char *data;
 
           DISKLED_ON;
 
-          f_lseek(&fdd_image[drv_sel-1].file, offset * 512);
-
           if((fdc_cmd & 0xe0) == 0x80) { 
-            // read from disk ...
-            FileReadBlock(&fdd_image[drv_sel-1].file, sector_buffer);
-            // ... and copy to ram
-            mist_memory_write_block(sector_buffer);
+            if((data = fdc_cache_sector(drv_sel, offset))) {
+              // copy the requested sectors up to the end of the track to ram at once
+              if(fdc_cmd & 0x10)
+                n = MIN(scnt, fdd_image[drv_sel-1].spt - offset % fdd_image[drv_sel-1].spt);
+              mist_memory_write_blocks(data, n);
+            } else {
+              // read from disk ...
+              f_lseek(&fdd_image[drv_sel-1].file, offset * 512);
+              FileReadBlock(&fdd_image[drv_sel-1].file, sector_buffer);
+              // ... and copy to ram
+              mist_memory_write_block(sector_buffer);
+            }
           } else {
             // read from ram ...
             mist_memory_read_block(sector_buffer);
             // ... and write to disk
+            f_lseek(&fdd_image[drv_sel-1].file, offset * 512);
             FileWriteBlock(&(fdd_image[drv_sel-1].file), sector_buffer);
+            fdc_cache_write(drv_sel, offset, sector_buffer);
           }
 
           DISKLED_OFF;
         } else
           tos_debugf("sector out of range");
 
-        scnt--;
-        dma_address += 512;
-        offset += 1;
+        scnt -= n;
+        dma_address += 512*n;
+        offset += n;
         if(!(fdc_cmd & 0x10)) break; // single sector
       }
       dma_ack(0x00);
@@ -599,7 +682,8 @@ static void handle_fdc(unsigned char *buffer) {
   }
 }
 
-static void mist_get_dmastate() {
+// returns 1 if an ACSI or FDC request was served
+static char mist_get_dmastate() {
   unsigned char buffer[32];
   unsigned int dma_address;
   unsigned char scnt;
@@ -636,11 +720,13 @@ static void mist_get_dmastate() {
     if(buffer[8] & 0x01) {
       handle_fdc(buffer);
     }
+    return (buffer[19] | buffer[8]) & 0x01;
   } else { // CORE_TYPE_MIST2
     if(buffer[10] & 0x01) {
       spi_newspeed = SPI_MMC_CLK_VALUE;
       handle_acsi(buffer);
     }
+    return buffer[10] & 0x01;
   }
 }
 
@@ -1102,11 +1188,11 @@ static unsigned long get_long(char *buffer, int offset) {
   return retval;
 }
 
-void tos_poll() {
+// returns 1 if a disk request was served
+char tos_poll() {
   // 1 == button not pressed, 2 = 1 sec exceeded, else timer running
   static unsigned long timer = 1;
-
-  mist_get_dmastate();
+  char busy = mist_get_dmastate();
 
   // check the user button
   if(!MenuButton() && UserButton()) {
@@ -1124,6 +1210,8 @@ void tos_poll() {
 
     timer = 1;
   }
+
+  return busy;
 }
 
 void tos_update_sysctrl(unsigned long n) {
@@ -1181,7 +1269,7 @@ void tos_select_hdd_image(char i, const unsigned char *name) {
     config.acsi_img[i][0] = 0;
   // try to open harddisk image
   if (disk_inserted[i+2]) {
-    f_close(&sd_image[i+2].file);
+    IDXClose(&sd_image[i+2]);
     disk_inserted[i+2] = 0;
   }
   config.system_ctrl &= ~(TOS_ACSI0_ENABLE<<i);
@@ -1205,6 +1293,7 @@ void tos_insert_disk(char i, const unsigned char *name) {
   }
 
   fdd_image[i].name[0] = 0;
+  fdc_cache_flush(i+1);
 
   tos_debugf("%c: eject", i+'A');
 
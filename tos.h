@@ -86,7 +86,7 @@
 unsigned long tos_system_ctrl(void);
 
 void tos_upload(const char *);
-void tos_poll();
+char tos_poll();
 void tos_update_sysctrl(unsigned long);
 char *tos_get_disk_name(char);
 char tos_disk_is_inserted(char index);
@@ -105,6 +105,7 @@ static uint8_t hid_get_report_descr(usb_device_t *dev, uint8_t i, uint16_t size)
 				hid_debugf("Detected USB joystick #%d", joystick_count());
 				info->iface[i].device_type = HID_DEVICE_JOYSTICK;
 				info->iface[i].jindex = joystick_add();
+				virtual_joystick_mapping_resolve(&info->iface[i].joymap, dev->vid, dev->pid);
 			}
 		} else {
 		// parsing failed. Fall back to boot mode for mice
@@ -421,6 +422,9 @@ static uint8_t usb_hid_init(usb_device_t *dev, usb_device_descriptor_t *dev_desc
 					  info->iface[0].conf.joystick_mouse.button[but].bitmask, but);
 				}
 			}
+
+			// the buttons may have moved, rebuild the extraction plan
+			compile_report_plan(&info->iface[0].conf);
 		}
 		rcode = hid_set_idle(dev, info->iface[i].iface_idx, 0, 0);
 		if (rcode && rcode != hrSTALL) {
@@ -568,52 +572,29 @@ static void handle_5200daptor(usb_device_t *dev, usb_hid_iface_info_t *iface, ui
 	}
 }
 
-// collect bits from byte stream and assemble them into a signed word
-static uint16_t collect_bits(uint8_t *p, uint16_t offset, uint8_t size, bool is_signed) {
-	// mask unused bits of first byte
-	uint8_t mask = 0xff << (offset&7);
-	uint8_t byte = offset/8;
-	uint8_t bits = size;
-	uint8_t shift = offset&7;
-
-	//  iprintf("0 m:%x by:%d bi=%d sh=%d ->", mask, byte, bits, shift);
-	uint16_t rval = (p[byte++] & mask) >> shift;
-	//  iprintf("%d\n", (int16_t)rval);
-	mask = 0xff;
-	shift = 8-shift;
-	bits -= shift;
-
-	// first byte already contained more bits than we need
-	if(shift > size) {
-		//    iprintf("  too many bits, masked %x ->", (1<<size)-1);
-		// mask unused bits
-		rval &= (1<<size)-1;
-		//    iprintf("%d\n", (int16_t)rval);
-	} else {
-		// further bytes if required
-		while(bits) {
-			mask = (bits<8)?(0xff>>(8-bits)):0xff;
-			//      iprintf("+ m:%x by:%d bi=%d sh=%d ->", mask, byte, bits, shift);
-			rval += (p[byte++] & mask) << shift;
-			//      iprintf("%d\n", (int16_t)rval);
-			shift += 8;
-			bits -= (bits>8)?8:bits;
-		}
-	}
+// extract a field from a report with its precompiled plan
+static inline uint16_t extract_field(const uint8_t *p, const hid_field_t *f) {
+	uint32_t v;
 
-	if(is_signed) {
-		// do sign expansion
-		uint16_t sign_bit = 1<<(size-1);
-		if(rval & sign_bit) {
-			while(sign_bit) {
-				rval |= sign_bit;
-				sign_bit <<= 1;
-			}
-			// iprintf(" is negative -> sign expand to %d\n", (int16_t)rval);
-		}
+	switch(f->bytes) {
+	case 0:
+		return 0;
+	case 1:
+		v = p[f->byte];
+		break;
+	case 2:
+		v = p[f->byte] | (p[f->byte+1] << 8);
+		break;
+	default:
+		v = p[f->byte] | (p[f->byte+1] << 8) | ((uint32_t)p[f->byte+2] << 16);
+		break;
 	}
+	v = (v >> f->shift) & f->mask;
+
+	// do sign expansion
+	if(f->is_signed && (v & ((f->mask >> 1) + 1))) v |= ~(uint32_t)f->mask;
 
-	return rval;
+	return v;
 }
 
 static usb_hid_iface_info_t *virt_joy_kbd_iface = NULL;
@@ -669,24 +650,25 @@ static void usb_process_iface (usb_device_t *dev,
 			// hid_debugf("data:"); hexdump(buf, read, 0);
 		
 			// several axes ...
-			for(i=0;i<MAX_AXES;i++) {
-				// if logical minimum is > logical maximum then logical minimum 
-				// is signed. This means that the value itself is also signed
-				bool is_signed = conf->joystick_mouse.axis[i].logical.min > 
-				conf->joystick_mouse.axis[i].logical.max;
-				a[i] = collect_bits(p, conf->joystick_mouse.axis[i].offset, 
-							conf->joystick_mouse.axis[i].size, is_signed);
+			for(i=0;i<MAX_AXES;i++)
+				a[i] = extract_field(p, &conf->joystick_mouse.plan.axis[i]);
+
+			if(conf->joystick_mouse.plan.buttons.bytes) {
+				// ... and all buttons at once
+				uint16_t b = extract_field(p, &conf->joystick_mouse.plan.buttons);
+				btn = b & 0x0f;
+				btn_extra = b >> 4;
+			} else {
+				// ... and four  first buttons
+				for(i=0;i<4;i++)
+					if(p[conf->joystick_mouse.button[i].byte_offset] & 
+					 conf->joystick_mouse.button[i].bitmask) btn |= (1<<i);
+
+				// ... and the eight extra buttons
+				for(i=4;i<12;i++)
+					if(p[conf->joystick_mouse.button[i].byte_offset] & 
+					 conf->joystick_mouse.button[i].bitmask) btn_extra |= (1<<(i-4));
 			}
-			
-			// ... and four  first buttons
-			for(i=0;i<4;i++)
-				if(p[conf->joystick_mouse.button[i].byte_offset] & 
-				 conf->joystick_mouse.button[i].bitmask) btn |= (1<<i);
-			
-			// ... and the eight extra buttons
-			for(i=4;i<12;i++)
-				if(p[conf->joystick_mouse.button[i].byte_offset] & 
-				 conf->joystick_mouse.button[i].bitmask) btn_extra |= (1<<(i-4));
 
 			//if (btn_extra != 0)
 			//  iprintf("EXTRA BTNS:%d\n", btn_extra);
@@ -750,8 +732,7 @@ static void usb_process_iface (usb_device_t *dev,
 
 				// handle hat if present and overwrite any axis value
 				if(conf->joystick_mouse.hat.size && !mist_cfg.joystick_ignore_hat) {
-					uint8_t hat = collect_bits(p, conf->joystick_mouse.hat.offset, 
-								 conf->joystick_mouse.hat.size, 0);
+					uint8_t hat = extract_field(p, &conf->joystick_mouse.plan.hat);
 
 					//  iprintf("HAT = %d\n", hat);
 
@@ -821,7 +802,7 @@ static void usb_process_iface (usb_device_t *dev,
 				// map virtual joypad
 				uint32_t vjoy = jmap;
 				vjoy |= btn_extra << 8;
-				vjoy = virtual_joystick_mapping( dev->vid, dev->pid, vjoy );
+				vjoy = virtual_joystick_mapping_cached( &iface->joymap, dev->vid, dev->pid, vjoy );
 
 				//iprintf("VIRTUAL JOY:%d\n", vjoy);
 				//if (jmap != 0) iprintf("JMAP pre map:%d\n", jmap);
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <inttypes.h>
 #include "hidparser.h"
+#include "joymapping.h"
 
 #define HID_LED_NUM_LOCK    0x01
 #define HID_LED_CAPS_LOCK   0x02
@@ -69,6 +70,7 @@ typedef struct {
   // (currently only used for joysticks) 
   uint32_t jmap;           // last reported joystick state
   uint16_t jindex;         // joystick index
+  joymapping_cache_t joymap; // virtual joystick mapping
   hid_report_t conf;
 
   uint8_t interval;
@@ -59,6 +59,62 @@ typedef struct {
 #define USAGE_WHEEL   56
 #define USAGE_HAT     57
 
+static void compile_field(hid_field_t *f, uint16_t offset, uint8_t size, bool is_signed) {
+	memset(f, 0, sizeof(hid_field_t));
+	if(!size) return;
+
+	// only the lower 16 bits of wider fields are used, unsigned
+	if(size > 16) {
+		size = 16;
+		is_signed = false;
+	}
+
+	f->byte = offset/8;
+	f->shift = offset&7;
+	f->bytes = (f->shift + size + 7)/8;
+	f->mask = 0xffff >> (16-size);
+	f->is_signed = is_signed;
+}
+
+// precompile the axis, hat and button fields, so that decoding a report
+// is just a few loads, shifts and masks per field. Has to be called again
+// whenever the button locations are changed after parsing
+void compile_report_plan(hid_report_t *conf) {
+	uint8_t i;
+	uint16_t first = 0;
+
+	if((conf->type != REPORT_TYPE_JOYSTICK) && (conf->type != REPORT_TYPE_MOUSE))
+		return;
+
+	for(i=0;i<MAX_AXES;i++)
+		// if logical minimum is > logical maximum then logical minimum
+		// is signed. This means that the value itself is also signed
+		compile_field(&conf->joystick_mouse.plan.axis[i],
+		              conf->joystick_mouse.axis[i].offset, conf->joystick_mouse.axis[i].size,
+		              conf->joystick_mouse.axis[i].logical.min > conf->joystick_mouse.axis[i].logical.max);
+
+	compile_field(&conf->joystick_mouse.plan.hat,
+	              conf->joystick_mouse.hat.offset, conf->joystick_mouse.hat.size, false);
+
+	// buttons are usually a run of single bits
+	for(i=0;i<conf->joystick_mouse.button_count;i++) {
+		uint16_t bit = conf->joystick_mouse.button[i].byte_offset*8;
+		uint8_t mask = conf->joystick_mouse.button[i].bitmask;
+		while(mask > 1) {
+			mask >>= 1;
+			bit++;
+		}
+		if(!i) first = bit;
+		else if(bit != first+i) break;
+	}
+	if(i == conf->joystick_mouse.button_count)
+		compile_field(&conf->joystick_mouse.plan.buttons, first, i, false);
+	else
+		memset(&conf->joystick_mouse.plan.buttons, 0, sizeof(hid_field_t));
+
+	hidp_debugf("  - %scontiguous buttons", conf->joystick_mouse.plan.buttons.bytes ? "" : "non-");
+}
+
 // check if the current report 
 bool report_is_usable(uint16_t bit_count, uint8_t report_complete, hid_report_t *conf) {
 	hidp_debugf("  - total bit count: %d (%d bytes, %d bits)", 
@@ -71,6 +127,7 @@ bool report_is_usable(uint16_t bit_count, uint8_t report_complete, hid_report_t
 	    ((conf->type == REPORT_TYPE_MOUSE)    && ((report_complete & MOUSE_COMPLETE) == MOUSE_COMPLETE)) ||
 	    ((conf->type == REPORT_TYPE_KEYBOARD))) {
 	hidp_debugf("  - report %d is usable", conf->report_id);
+	compile_report_plan(conf);
 	return true;
 	}
 
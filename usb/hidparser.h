@@ -9,6 +9,16 @@
 #define MAX_AXES 4
 #define MAX_BUTTONS 12
 
+// a report field precompiled for extraction: the bytes at byte are
+// loaded little endian, shifted right and masked
+typedef struct {
+  uint8_t byte;                // first byte
+  uint8_t shift: 3;            // bit within the first byte
+  uint8_t bytes: 2;            // bytes to load (1..3), 0 if the field is absent
+  uint8_t is_signed: 1;        // sign expand from the top bit of mask
+  uint16_t mask;
+} hid_field_t;
+
 // currently only joysticks are supported
 typedef struct {
   uint8_t type: 2;             // REPORT_TYPE_...
@@ -46,10 +56,17 @@ typedef struct {
 
 			uint8_t button_count;
       
+      // extraction plan, compiled once the report is known to be usable
+      struct {
+        hid_field_t axis[MAX_AXES];
+        hid_field_t hat;
+        hid_field_t buttons;   // all buttons, if they are contiguous bits
+      } plan;
     } joystick_mouse;
   };
 } hid_report_t;
 
 bool parse_report_descriptor(uint8_t *rep, uint16_t rep_size, hid_report_t *conf);
+void compile_report_plan(hid_report_t *conf);
 
 #endif // HIDPARSER_H
@@ -44,6 +44,13 @@ This file defines how to handle mapping in the MiST controllers in various ways:
 
 static joymapping_t joystick_mappers[MAX_VIRTUAL_JOYSTICK_REMAP];
 
+// changed whenever the remap entries change, so cached mappings get resolved again
+static uint32_t remap_generation = 1;
+
+static void remap_changed() {
+	if(!++remap_generation) remap_generation = 1;
+}
+
 static uint16_t default_joystick_mapping [16] = {
 	JOY_RIGHT,
 	JOY_LEFT,
@@ -76,8 +83,10 @@ static char idx = 0;
 void virtual_joystick_remap_init(char save) {
   if(save)
     idx = 0;
-  else
+  else {
     memset(joystick_mappers, 0, sizeof(joystick_mappers));
+    remap_changed();
+  }
 }
 
 /* Parses an input comma-separated string into a mapping strucutre
@@ -180,6 +189,7 @@ char virtual_joystick_remap(char *s, char action, int tag) {
         token = strtok (NULL, ",");
         count++;
       }
+      remap_changed();
       return 0; // finished processing input string so exit
     }
   }
@@ -193,6 +203,7 @@ void virtual_joystick_remap_update(joymapping_t *map) {
 		    joystick_mappers[i].tag == map->tag) ||
 		    !joystick_mappers[i].vid) {
 			memcpy(&joystick_mappers[i], map, sizeof(joymapping_t));
+			remap_changed();
 			return;
 		}
 	}
@@ -211,6 +222,7 @@ void virtual_joystick_tag_update(uint16_t vid, uint16_t pid, int newtag)
 		}
 	}
 	if (old == -1) return; // old entry not found
+	remap_changed();
 
 	// now search if the entry with the same newtag already there
 	for(i=0;i<MAX_VIRTUAL_JOYSTICK_REMAP;i++) {
@@ -304,172 +316,179 @@ char* get_joystick_alias( uint16_t vid, uint16_t pid ) {
 /* Translates USB input into internal virtual joystick,
    with some default handling for common/known gampads */
 
-uint16_t virtual_joystick_mapping (uint16_t vid, uint16_t pid, uint16_t joy_input) {
-	
-	uint8_t i;
-	
-	// defines translations between physical buttons and virtual joysticks
-    uint16_t mapping[16];
-	// keep directions by default
-	for(i=0; i<4; i++) 
-	   mapping[i]=default_joystick_mapping[i]; 
-	// blank the rest
-	for(i=4; i<16; i++) mapping[i]=0;
-
-	uint8_t use_default=1;
-	uint8_t btn_off = 3; // start at three since array is 0 based, so 4 = button 1
-	
-	// mapping for Qanba Q4RAF
-	if( vid==0x0F30 && pid==0x1012) {
-	  mapping[btn_off+1]  = JOY_A;
-	  mapping[btn_off+2]  = JOY_B;
-	  mapping[btn_off+4]  = JOY_A;
-	  mapping[btn_off+3]  = JOY_B;     
-	  mapping[btn_off+5]  = JOY_X; //for jump
-	  mapping[btn_off+6]  = JOY_SELECT;
-	  mapping[btn_off+8]  = JOY_SELECT;
-	  mapping[btn_off+10] = JOY_START;       
-	  use_default=0;
-	}
-	
-	// mapping for no-brand cheap snes clone pad
-	if(vid==0x081F && pid==0xE401) {
-	  mapping[btn_off+2]  = JOY_A;
-	  mapping[btn_off+3]  = JOY_B;
-	  mapping[btn_off+1]  = JOY_B; // allow two ways to hold the controller  
-	  mapping[btn_off+4]  = JOY_UP;
-	  mapping[btn_off+5]  = JOY_L | JOY_L2; // also bind to buttons for flippers
-	  mapping[btn_off+6]  = JOY_R | JOY_R2; 
-	  mapping[btn_off+9]  = JOY_SELECT;
-	  mapping[btn_off+10] = JOY_START;       
-	  use_default=0;
-	}
-	
-	// mapping for iBuffalo SNES pad - BSGP801
-	if(vid==0x0583 && pid==0x2060) {
-	  mapping[btn_off+1] = JOY_A;
-	  mapping[btn_off+2] = JOY_B;
-	  mapping[btn_off+3] = JOY_B;  // allow two ways to hold the controller
-	  mapping[btn_off+4] = JOY_UP; 
-	  mapping[btn_off+5] = JOY_L | JOY_L2; // also bind to buttons for flippers
-	  mapping[btn_off+6] = JOY_R | JOY_R2;                 
-	  mapping[btn_off+7] = JOY_SELECT;
-	  mapping[btn_off+8] = JOY_START;
-	  use_default=0;
-	}
-	
+// defines translations between physical buttons and virtual joysticks for
+// known gamepads, sorted by vid and pid. Directions are kept, unlisted
+// buttons are not used
+#define JOY_DIRECTIONS JOY_RIGHT, JOY_LEFT, JOY_DOWN, JOY_UP
+#define BTN(n) [3+(n)]     // button n, 4 = button 1
+
+#define JOY_8BITDO_SFC30 { JOY_DIRECTIONS, \
+	BTN(1) = JOY_A, \
+	BTN(2) = JOY_B, \
+	/* physical button #3 not used */ \
+	BTN(4) = JOY_X, \
+	BTN(5) = JOY_Y, \
+	/* physical button #6 not used */ \
+	BTN(7) = JOY_L | JOY_L2, /* also bind to buttons for flippers */ \
+	BTN(8) = JOY_R | JOY_R2, /* also bind to buttons for flippers */ \
+	/* 9 and 10 not used */ \
+	BTN(11) = JOY_SELECT, \
+	BTN(12) = JOY_START }
+
+static const struct {
+	uint16_t vid;
+	uint16_t pid;
+	uint16_t mapping[16];
+} known_joystick_mappings[] = {
+	//mapping for RetroLink N64 and Gamecube pad (same vid/pid)
+	{ VID_RETROLINK, 0x0006, { JOY_DIRECTIONS,
+		BTN(7) = JOY_A,  // A on N64 pad
+		BTN(9) = JOY_B,  // B on N64 pad
+		BTN(3) = JOY_A,  // A on GC pad
+		BTN(4) = JOY_B,  // B on GC pad
+		BTN(5) = JOY_L | JOY_SELECT,
+		BTN(8) = JOY_L | JOY_SELECT, // Z button on N64 pad
+		BTN(6) = JOY_R | JOY_SELECT,
+		BTN(10) = JOY_START } },
+
 	//mapping for Buffalo NES pad - BGCFC801
-	if(vid==0x0411 && pid==0x00C6) {
-	  mapping[btn_off+1] = JOY_A;
-	  mapping[btn_off+2] = JOY_B;
-	  mapping[btn_off+3] = JOY_B;  // allow two ways to hold the controller
-	  mapping[btn_off+4] = JOY_UP; 
-	  mapping[btn_off+5] = JOY_L | JOY_L2; // also bind to buttons for flippers
-	  mapping[btn_off+6] = JOY_R | JOY_R2;                     
-	  mapping[btn_off+7] = JOY_SELECT;
-	  mapping[btn_off+8] = JOY_START;
-	  use_default=0;
-	} 
+	{ 0x0411, 0x00C6, { JOY_DIRECTIONS,
+		BTN(1) = JOY_A,
+		BTN(2) = JOY_B,
+		BTN(3) = JOY_B,  // allow two ways to hold the controller
+		BTN(4) = JOY_UP,
+		BTN(5) = JOY_L | JOY_L2, // also bind to buttons for flippers
+		BTN(6) = JOY_R | JOY_R2,
+		BTN(7) = JOY_SELECT,
+		BTN(8) = JOY_START } },
 
-	//mapping for RetroLink N64 and Gamecube pad (same vid/pid)
-	if(vid==VID_RETROLINK && pid==0x0006) {
-	  mapping[btn_off+7] = JOY_A;  // A on N64 pad
-	  mapping[btn_off+9] = JOY_B;  // B on N64 pad
-	  mapping[btn_off+3] = JOY_A;  // A on GC pad
-	  mapping[btn_off+4] = JOY_B;  // B on GC pad
-	  mapping[btn_off+5] = JOY_L | JOY_SELECT;
-	  mapping[btn_off+8] = JOY_L | JOY_SELECT; // Z button on N64 pad
-	  mapping[btn_off+6] = JOY_R | JOY_SELECT;
-	  mapping[btn_off+10] = JOY_START;
-	  use_default=0;
-	}
-	
-	//mapping for ROYDS Stick.EX
-	if(vid==0x1F4F && pid==0x0003) {
-	  mapping[btn_off+3] = JOY_A;  // Circle (usually select in PSx)
-	  mapping[btn_off+1] = JOY_B;  // Cross  (usually cancel in PSx)
-	  mapping[btn_off+2] = JOY_X;  // Triangle
-	  mapping[btn_off+4] = JOY_Y;  // Square
-	  mapping[btn_off+5] = JOY_L;
-	  mapping[btn_off+6] = JOY_R; 
-	  mapping[btn_off+7] = JOY_L2; 
-	  mapping[btn_off+8] = JOY_R2;
-	  mapping[btn_off+9] = JOY_SELECT;
-	  mapping[btn_off+10] = JOY_START;
-	  use_default=0;
-	}
-	
 	//mapping for NEOGEO-daptor
-	if(vid==VID_DAPTOR && pid==0xF421) {
-	  mapping[btn_off+1] = JOY_B;  // red button "A" on pad (inverted order with NES/SNES
-	  mapping[btn_off+2] = JOY_A;  // yellow button "B" on pad (inverted order with NES/SNES
-	  mapping[btn_off+3] = JOY_Y | JOY_L;  // green button, "C" on pad (mapped to Y and L in SNES convention)
-	  mapping[btn_off+4] = JOY_X | JOY_R;  // blue button "D"  
-	  mapping[btn_off+5] = JOY_START;
-	  mapping[btn_off+6] = JOY_SELECT;
-	  use_default=0;
-	}
-	
+	{ VID_DAPTOR, 0xF421, { JOY_DIRECTIONS,
+		BTN(1) = JOY_B,  // red button "A" on pad (inverted order with NES/SNES
+		BTN(2) = JOY_A,  // yellow button "B" on pad (inverted order with NES/SNES
+		BTN(3) = JOY_Y | JOY_L,  // green button, "C" on pad (mapped to Y and L in SNES convention)
+		BTN(4) = JOY_X | JOY_R,  // blue button "D"
+		BTN(5) = JOY_START,
+		BTN(6) = JOY_SELECT } },
+
+	// mapping for iBuffalo SNES pad - BSGP801
+	{ 0x0583, 0x2060, { JOY_DIRECTIONS,
+		BTN(1) = JOY_A,
+		BTN(2) = JOY_B,
+		BTN(3) = JOY_B,  // allow two ways to hold the controller
+		BTN(4) = JOY_UP,
+		BTN(5) = JOY_L | JOY_L2, // also bind to buttons for flippers
+		BTN(6) = JOY_R | JOY_R2,
+		BTN(7) = JOY_SELECT,
+		BTN(8) = JOY_START } },
+
+	// mapping for no-brand cheap snes clone pad
+	{ 0x081F, 0xE401, { JOY_DIRECTIONS,
+		BTN(2) = JOY_A,
+		BTN(3) = JOY_B,
+		BTN(1) = JOY_B, // allow two ways to hold the controller
+		BTN(4) = JOY_UP,
+		BTN(5) = JOY_L | JOY_L2, // also bind to buttons for flippers
+		BTN(6) = JOY_R | JOY_R2,
+		BTN(9) = JOY_SELECT,
+		BTN(10) = JOY_START } },
+
+	// mapping for Qanba Q4RAF
+	{ 0x0F30, 0x1012, { JOY_DIRECTIONS,
+		BTN(1) = JOY_A,
+		BTN(2) = JOY_B,
+		BTN(4) = JOY_A,
+		BTN(3) = JOY_B,
+		BTN(5) = JOY_X, //for jump
+		BTN(6) = JOY_SELECT,
+		BTN(8) = JOY_SELECT,
+		BTN(10) = JOY_START } },
+
+	//mapping for 8bitdo FC30
+	{ 0x1002, 0x9000, { JOY_DIRECTIONS,
+		BTN(1) = JOY_A,
+		BTN(2) = JOY_B,
+		// physical button #3 not used
+		BTN(4) = JOY_X,
+		BTN(5) = JOY_Y,
+		// physical button #6 not used
+		BTN(7) = JOY_L | JOY_L2, // also bind to buttons for flippers
+		BTN(8) = JOY_R | JOY_R2, // also bind to buttons for flippers
+		BTN(9) = JOY_L | JOY_L2, // also bind to buttons for flippers
+		BTN(10) = JOY_R | JOY_R2, // also bind to buttons for flippers
+		BTN(11) = JOY_SELECT,
+		BTN(12) = JOY_START } },
+
 	//mapping for 8bitdo SFC30
-	if(vid==0x1235 && (pid==0xab11 || pid==0xab21)) {
-		mapping[btn_off+1] = JOY_A;
-	  mapping[btn_off+2] = JOY_B;
-	  //mapping[btn_off+3] // physical button #3 not used
-		mapping[btn_off+4] = JOY_X;
-		mapping[btn_off+5] = JOY_Y;
-	  //mapping[btn_off+6] // physical button #6 not used
-		mapping[btn_off+7] = JOY_L | JOY_L2; // also bind to buttons for flippers
-	  mapping[btn_off+8] = JOY_R | JOY_R2; // also bind to buttons for flippers
-	  //9 and 10 not used
-		mapping[btn_off+11] = JOY_SELECT;
-		mapping[btn_off+12] = JOY_START;
-		use_default=0;
-	}
-	
-		//mapping for 8bitdo FC30
-	if(vid==0x1002 && pid==0x9000) {
-		mapping[btn_off+1] = JOY_A;
-	  mapping[btn_off+2] = JOY_B;
-	  //mapping[btn_off+3] // physical button #3 not used
-		mapping[btn_off+4] = JOY_X;
-		mapping[btn_off+5] = JOY_Y;
-	  //mapping[btn_off+6] // physical button #6 not used
-		mapping[btn_off+7] = JOY_L | JOY_L2; // also bind to buttons for flippers
-	  mapping[btn_off+8] = JOY_R | JOY_R2; // also bind to buttons for flippers
-		mapping[btn_off+9] = JOY_L | JOY_L2; // also bind to buttons for flippers
-	  mapping[btn_off+10] = JOY_R | JOY_R2; // also bind to buttons for flippers		
-		mapping[btn_off+11] = JOY_SELECT;
-		mapping[btn_off+12] = JOY_START;
-		use_default=0;
-	}
-	
+	{ 0x1235, 0xab11, JOY_8BITDO_SFC30 },
+	{ 0x1235, 0xab21, JOY_8BITDO_SFC30 },
+
+	//mapping for ROYDS Stick.EX
+	{ 0x1F4F, 0x0003, { JOY_DIRECTIONS,
+		BTN(3) = JOY_A,  // Circle (usually select in PSx)
+		BTN(1) = JOY_B,  // Cross  (usually cancel in PSx)
+		BTN(2) = JOY_X,  // Triangle
+		BTN(4) = JOY_Y,  // Square
+		BTN(5) = JOY_L,
+		BTN(6) = JOY_R,
+		BTN(7) = JOY_L2,
+		BTN(8) = JOY_R2,
+		BTN(9) = JOY_SELECT,
+		BTN(10) = JOY_START } },
+};
+
+static const uint16_t *find_mapping(uint16_t vid, uint16_t pid) {
+	const uint16_t *mapping = 0;
+	uint32_t id = ((uint32_t)vid << 16) | pid;
+	int lo = 0, hi = sizeof(known_joystick_mappings)/sizeof(known_joystick_mappings[0]) - 1;
+
 	// Apply remap information from various config sources if present
 	// Priority (low to high):
 	// 0 - mist.ini
 	// 1 - mistcfg.ini
 	// 2 - [corename].cfg
-	uint8_t j;
 	int tag = 0;
-	for(j=0;j<MAX_VIRTUAL_JOYSTICK_REMAP;j++) {
+	for(int j=0;j<MAX_VIRTUAL_JOYSTICK_REMAP;j++) {
 		if(joystick_mappers[j].vid==vid && joystick_mappers[j].pid==pid && joystick_mappers[j].tag >= tag) {
-			for(i=0; i<16; i++)
-				mapping[i]=joystick_mappers[j].mapping[i];
-			use_default=0;
+			mapping = joystick_mappers[j].mapping;
 			tag = joystick_mappers[j].tag + 1;
 		}
 	}
-
-	// apply default mapping to rest of buttons if requested
-	if (use_default) {
-	  for(i=4; i<16; i++) 
-		if (mapping[i]==0) mapping[i]=default_joystick_mapping[i];
+	if(mapping) return mapping;
+
+	// known gamepads
+	while(lo <= hi) {
+		int mid = (lo + hi) / 2;
+		uint32_t mid_id = ((uint32_t)known_joystick_mappings[mid].vid << 16) | known_joystick_mappings[mid].pid;
+		if(mid_id == id) return known_joystick_mappings[mid].mapping;
+		if(mid_id < id) lo = mid + 1;
+		else hi = mid - 1;
 	}
-	
+
+	// default mapping for all buttons
+	return default_joystick_mapping;
+}
+
+static uint16_t translate(const uint16_t *mapping, uint16_t joy_input) {
 	uint16_t vjoy = 0;
-	for(i=0; i<16; i++) 
-	  if (joy_input & (0x01<<i))  vjoy |= mapping[i];
-  
-  return vjoy;
+	for(; joy_input; joy_input >>= 1, mapping++)
+		if (joy_input & 0x01) vjoy |= *mapping;
+	return vjoy;
+}
+
+void virtual_joystick_mapping_resolve(joymapping_cache_t *cache, uint16_t vid, uint16_t pid) {
+	cache->mapping = find_mapping(vid, pid);
+	cache->generation = remap_generation;
+}
+
+uint16_t virtual_joystick_mapping_cached(joymapping_cache_t *cache, uint16_t vid, uint16_t pid, uint16_t joy_input) {
+	if(cache->generation != remap_generation)
+		virtual_joystick_mapping_resolve(cache, vid, pid);
+	return translate(cache->mapping, joy_input);
+}
+
+uint16_t virtual_joystick_mapping (uint16_t vid, uint16_t pid, uint16_t joy_input) {
+	return translate(find_mapping(vid, pid), joy_input);
 }
 
 /*****************************************************************************\
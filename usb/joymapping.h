@@ -57,6 +57,12 @@ typedef struct {
     int      tag;
 } joymapping_t;
 
+// mapping of a device, resolved once and again only after remap changes
+typedef struct {
+    const uint16_t *mapping;
+    uint32_t generation;
+} joymapping_cache_t;
+
 /*****************************************************************************/
 
 // INI parsing
@@ -69,6 +75,8 @@ void virtual_joystick_tag_update(uint16_t vid, uint16_t pid, int newtag);
 
 // runtime mapping
 uint16_t virtual_joystick_mapping (uint16_t vid, uint16_t pid, uint16_t joy_input);
+void virtual_joystick_mapping_resolve(joymapping_cache_t *cache, uint16_t vid, uint16_t pid);
+uint16_t virtual_joystick_mapping_cached(joymapping_cache_t *cache, uint16_t vid, uint16_t pid, uint16_t joy_input);
 
 // name known joysticks
 char* get_joystick_alias( uint16_t vid, uint16_t pid );
@@ -143,6 +143,7 @@ uint8_t usb_xbox_init(usb_device_t *dev, usb_device_descriptor_t *dev_desc) {
 	}
 
 	memset(&dev->xbox_info, 0, sizeof(dev->xbox_info));
+	virtual_joystick_mapping_resolve(&dev->xbox_info.joymap, vid, pid);
 
 	if(rcode = usb_get_conf_descr(dev, sizeof(usb_configuration_descriptor_t), 0, &conf_desc))
 		return rcode;
@@ -219,7 +220,7 @@ static void usb_xbox_read_report(usb_device_t *dev, uint16_t len, uint8_t *buf)
 	if(((buf[13]+128) & 0xFF) > JOYSTICK_AXIS_TRIGGER_MAX) jmap |= JOY_UP;
 	buttons |= (jmap << 16);
 
-	uint32_t vjoy = virtual_joystick_mapping(dev->vid, dev->pid, buttons);
+	uint32_t vjoy = virtual_joystick_mapping_cached(&dev->xbox_info.joymap, dev->vid, dev->pid, buttons);
 	// add right stick (no remap)
 	vjoy |= (jmap << 16);
 
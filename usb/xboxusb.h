@@ -56,6 +56,7 @@ typedef struct {
 	ep_t     inEp;
   ep_t     outEp;
 	uint16_t jindex;
+	joymapping_cache_t joymap;
 } usb_xbox_info_t;
 
 // interface to usb core
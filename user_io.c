@@ -13,6 +13,7 @@
 #include "neocd.h"
 #include "psx.h"
 #include "hdd.h"
+#include "fdd.h"
 #include "cdc_control.h"
 #include "usb.h"
 #include "debug.h"
@@ -43,9 +44,65 @@ unsigned char key_remap_table[MAX_REMAP][2];
 #define BREAK  0x8000
 
 static char umounted; // 1st image is file or direct SD?
-static char cache_buffer[1024];
-static uint8_t buffer_drive_index = 0;
-static uint32_t buffer_lba = 0xffffffff;
+
+// read-ahead cache for the sd card emulation. Lines are shared between
+// all drives and replaced in LRU order, each holding a run of 512 byte sectors
+#ifndef SD_CACHE_LINES
+#define SD_CACHE_LINES 2
+#endif
+#ifndef SD_CACHE_LINE_SIZE
+#define SD_CACHE_LINE_SIZE 1024
+#endif
+#define SD_CACHE_LINE_SECTORS (SD_CACHE_LINE_SIZE/512)
+#define SD_CACHE_UNUSED 0xff
+
+typedef struct {
+	uint8_t drive;       // drive index or SD_CACHE_UNUSED
+	uint8_t count;       // number of valid sectors
+	uint32_t lba;        // first sector stored in this line
+	uint32_t stamp;      // last access for LRU replacement
+} sd_cache_line_t;
+
+static sd_cache_line_t sd_cache_line[SD_CACHE_LINES];
+static uint8_t sd_cache_data[SD_CACHE_LINES][SD_CACHE_LINE_SIZE] __attribute__ ((aligned (4)));
+static uint32_t sd_cache_stamp;
+static uint32_t sd_cache_next[SD_IMAGES];  // sector following the last read
+static uint8_t sd_cache_depth[SD_IMAGES];  // read-ahead depth in sectors
+static uint32_t sd_card_sectors;           // card size in direct mode, 0: not read yet
+static void sd_cache_invalidate(uint8_t drive);
+
+// optional write-back buffer for the sd card emulation (sd_write_back=1).
+// Consecutive sector writes are merged and written with a single
+// multi-sector write. A line with count == 0 is unused
+#ifndef SD_WRBUF_LINES
+#define SD_WRBUF_LINES 1
+#endif
+#ifndef SD_WRBUF_LINE_SIZE
+#define SD_WRBUF_LINE_SIZE 2048
+#endif
+#define SD_WRBUF_LINE_SECTORS (SD_WRBUF_LINE_SIZE/512)
+#define SD_WRBUF_IDLE    20   // ms without writes before flushing
+#define SD_WRBUF_MAX_AGE 500  // ms a sector stays dirty at most
+
+typedef struct {
+	uint8_t drive;
+	uint8_t count;         // number of dirty sectors
+	uint32_t lba;          // first sector of the dirty run
+	unsigned long timer;   // flush deadline of the oldest sector
+} sd_wrbuf_line_t;
+
+static sd_wrbuf_line_t sd_wrbuf_line[SD_WRBUF_LINES];
+static uint8_t sd_wrbuf_data[SD_WRBUF_LINES][SD_WRBUF_LINE_SIZE] __attribute__ ((aligned (4)));
+static unsigned long sd_wrbuf_idle_timer;
+static void sd_wrbuf_flush(uint8_t drive);
+
+// polling of the TOS DMA, sd card emulation and IDE requests
+#define REQ_POLL_ACTIVE 20   // ms after a request with continuous polling
+#define REQ_POLL_IDLE   1    // ms between polls otherwise
+
+static fpga_req_poll_t tos_req_poll;
+static fpga_req_poll_t sd_req_poll;
+static fpga_req_poll_t ide_req_poll;
 
 extern char s[FF_LFN_BUF + 1];
 
@@ -140,14 +197,21 @@ char user_io_osd_is_visible() {
 }
 
 void user_io_reset() {
+	// write back anything still buffered for the old core
+	sd_wrbuf_flush(SD_CACHE_UNUSED);
+	FlushTrackCache();
+
 	// no sd card image selected, SD card accesses will go directly
 	// to the card (first slot, and only until the first unmount)
 	umounted = 0;
+	sd_cache_invalidate(SD_CACHE_UNUSED);
 	toc.valid = 0;
-	sd_image[0].valid = 0;
-	sd_image[1].valid = 0;
-	sd_image[2].valid = 0;
-	sd_image[3].valid = 0;
+	// close the images of the old core, so their link maps don't keep
+	// the index pool occupied
+	for (int i=0; i<SD_IMAGES; i++) {
+		IDXClose(&sd_image[i]);
+		sd_image[i].valid = 0;
+	}
 	for (int i=0; i<HARDFILES; i++) {
 		hardfiles[i].enabled = HDF_DISABLED;
 		hardfiles[i].present = 0;
@@ -701,9 +765,19 @@ void user_io_eth_receive_tx_frame(uint8_t *d, uint16_t len) {
 
 // write ethernet frame to FPGAs rx buffer
 void user_io_eth_send_rx_frame(uint8_t *s, uint16_t len) {
+	user_io_eth_send_rx_start();
+	user_io_eth_send_rx_data(s, len);
+	user_io_eth_send_rx_end();
+}
+// send a frame in parts, e.g. directly from the ethernet rx buffers
+void user_io_eth_send_rx_start(void) {
 	spi_uio_cmd_cont(UIO_ETH_FRM_OUT);
+}
+void user_io_eth_send_rx_data(const uint8_t *s, uint16_t len) {
 	while(len--) SPI(*s++);
 	//spi_write(s, len);
+}
+void user_io_eth_send_rx_end(void) {
 	spi8(0);     // one additional byte to allow fpga to store the previous one
 	DisableIO();
 }
@@ -792,6 +866,9 @@ char user_io_is_cue_mounted() {
 
 char user_io_cue_mount(const unsigned char *name, unsigned char index) {
 	char res = CUE_RES_OK;
+
+	sd_wrbuf_flush(index);
+	sd_cache_invalidate(index); // invalidate cache
 	toc.valid = 0;
 	if (name) {
 		res = cue_parse(name, &sd_image[index]);
@@ -803,8 +880,8 @@ char user_io_cue_mount(const unsigned char *name, unsigned char index) {
 	EnableIO();
 	SPI(UIO_SET_SDINFO);
 	// use LE version, so following BYTE(s) may be used for size extension in the future.
-	spi32le(toc.valid ? f_size(&toc.file->file) : 0);
-	spi32le(toc.valid ? f_size(&toc.file->file) >> 32 : 0);
+	spi32le(toc.valid ? toc.size : 0);
+	spi32le(toc.valid ? toc.size >> 32 : 0);
 	spi32le(0); // reserved for future expansion
 	spi32le(0); // reserved for future expansion
 	DisableIO();
@@ -822,6 +899,236 @@ static inline char sd_index(unsigned char index) {
 		return index;
 }
 
+// 512 byte sector of a request. Image files are addressed in blocks of
+// 512<<blksz bytes, the card in direct mode by its sector number.
+static uint32_t sd_sector(uint8_t drive, uint32_t lba, uint8_t blksz) {
+	if (!sd_image[sd_index(drive)].valid && !drive && !umounted)
+		return lba;
+	return lba << blksz;
+}
+
+// write sectors to the image file or to the card in direct mode
+static void sd_disk_write(uint8_t drive, const uint8_t *buf, uint32_t lba, uint8_t count) {
+	IDXFile *img = &sd_image[sd_index(drive)];
+	UINT bw;
+
+	DISKLED_ON;
+	if (img->valid) {
+		FSIZE_t size = f_size(&img->file);
+		// never write beyond the end of the image
+		if (((FSIZE_t)lba << 9) < size) {
+			if (((FSIZE_t)(lba + count) << 9) > size)
+				count = (size - ((FSIZE_t)lba << 9) + 511) >> 9;
+			if (IDXSeek(img, lba) == FR_OK)
+				f_write(&img->file, buf, count << 9, &bw);
+		}
+	} else if (!drive && !umounted) {
+		disk_write(fs.pdrv, buf, lba, count);
+	}
+	DISKLED_OFF;
+}
+
+static void sd_wrbuf_flush_line(sd_wrbuf_line_t *line) {
+	if (!line->count) return;
+	if (user_io_dip_switch1())
+		iprintf("SD WB (%d) %d/%d\n", line->drive, line->lba, line->count);
+	sd_disk_write(line->drive, sd_wrbuf_data[line - sd_wrbuf_line], line->lba, line->count);
+	line->count = 0;
+}
+
+// write back the dirty sectors of a drive overlapping an area
+static void sd_wrbuf_flush_range(uint8_t drive, uint32_t lba, uint8_t count) {
+	for (int i=0; i<SD_WRBUF_LINES; i++) {
+		sd_wrbuf_line_t *line = &sd_wrbuf_line[i];
+		if (line->count && line->drive == drive && lba < line->lba + line->count && line->lba < lba + count)
+			sd_wrbuf_flush_line(line);
+	}
+}
+
+// write back all dirty sectors of a drive (SD_CACHE_UNUSED: all drives)
+static void sd_wrbuf_flush(uint8_t drive) {
+	for (int i=0; i<SD_WRBUF_LINES; i++)
+		if (drive == SD_CACHE_UNUSED || sd_wrbuf_line[i].drive == drive)
+			sd_wrbuf_flush_line(&sd_wrbuf_line[i]);
+}
+
+static void sd_wrbuf_write(uint8_t drive, const uint8_t *buf, uint32_t lba, uint8_t count) {
+	sd_wrbuf_line_t *line;
+	int i, idx;
+
+	sd_wrbuf_idle_timer = GetTimer(SD_WRBUF_IDLE);
+
+	// rewrite of sectors already in the buffer
+	for (i=0; i<SD_WRBUF_LINES; i++) {
+		line = &sd_wrbuf_line[i];
+		if (line->count && line->drive == drive && lba >= line->lba && lba + count <= line->lba + line->count) {
+			memcpy(sd_wrbuf_data[i] + ((lba - line->lba) << 9), buf, count << 9);
+			return;
+		}
+	}
+
+	// older data partially covering this area has to reach the disk first
+	sd_wrbuf_flush_range(drive, lba, count);
+
+	// continue a dirty run
+	for (i=0; i<SD_WRBUF_LINES; i++) {
+		line = &sd_wrbuf_line[i];
+		if (line->count && line->drive == drive && lba == line->lba + line->count &&
+		    line->count + count <= SD_WRBUF_LINE_SECTORS) {
+			memcpy(sd_wrbuf_data[i] + (line->count << 9), buf, count << 9);
+			line->count += count;
+			// a full line won't grow anymore
+			if (line->count == SD_WRBUF_LINE_SECTORS) sd_wrbuf_flush_line(line);
+			return;
+		}
+	}
+
+	// start a new run, writing back the oldest one if no line is free
+	idx = 0;
+	for (i=0; i<SD_WRBUF_LINES; i++) {
+		if (!sd_wrbuf_line[i].count) {
+			idx = i;
+			break;
+		}
+		if ((long)(sd_wrbuf_line[i].timer - sd_wrbuf_line[idx].timer) < 0) idx = i;
+	}
+	line = &sd_wrbuf_line[idx];
+	sd_wrbuf_flush_line(line);
+	memcpy(sd_wrbuf_data[idx], buf, count << 9);
+	line->drive = drive;
+	line->lba = lba;
+	line->count = count;
+	line->timer = GetTimer(SD_WRBUF_MAX_AGE);
+}
+
+// flush when the core stopped writing or data got too old
+static void sd_wrbuf_poll() {
+	for (int i=0; i<SD_WRBUF_LINES; i++) {
+		sd_wrbuf_line_t *line = &sd_wrbuf_line[i];
+		if (line->count && (CheckTimer(sd_wrbuf_idle_timer) || CheckTimer(line->timer)))
+			sd_wrbuf_flush_line(line);
+	}
+}
+
+// drop all cached sectors of a drive (SD_CACHE_UNUSED: all drives)
+static void sd_cache_invalidate(uint8_t drive) {
+	if (drive == SD_CACHE_UNUSED || !drive) sd_card_sectors = 0;
+	for (int i=0; i<SD_CACHE_LINES; i++)
+		if (drive == SD_CACHE_UNUSED || sd_cache_line[i].drive == drive)
+			sd_cache_line[i].drive = SD_CACHE_UNUSED;
+	for (int i=0; i<SD_IMAGES; i++) {
+		if (drive == SD_CACHE_UNUSED || i == drive) {
+			sd_cache_next[i] = 0xffffffff;
+			sd_cache_depth[i] = 1;
+		}
+	}
+}
+
+// drop the lines overlapping a written area
+static void sd_cache_write(uint8_t drive, uint32_t lba, uint8_t count) {
+	for (int i=0; i<SD_CACHE_LINES; i++) {
+		sd_cache_line_t *line = &sd_cache_line[i];
+		if (line->drive == drive && lba < line->lba + line->count && line->lba < lba + count)
+			line->drive = SD_CACHE_UNUSED;
+	}
+}
+
+static uint8_t *sd_cache_lookup(uint8_t drive, uint32_t lba, uint8_t count) {
+	for (int i=0; i<SD_CACHE_LINES; i++) {
+		sd_cache_line_t *line = &sd_cache_line[i];
+		if (line->drive == drive && lba >= line->lba && lba + count <= line->lba + line->count) {
+			line->stamp = ++sd_cache_stamp;
+			return sd_cache_data[i] + ((lba - line->lba) << 9);
+		}
+	}
+	return 0;
+}
+
+// sectors of the card for direct mode, read once (from the CSD) after an
+// invalidate. 0 if the card doesn't report its size.
+static uint32_t sd_card_size() {
+	if (!sd_card_sectors) disk_ioctl(fs.pdrv, GET_SECTOR_COUNT, &sd_card_sectors);
+	return sd_card_sectors;
+}
+
+// read count sectors starting at lba into the least recently used line
+static uint8_t *sd_cache_fill(uint8_t drive, uint32_t lba, uint8_t count) {
+	IDXFile *img = &sd_image[sd_index(drive)];
+	sd_cache_line_t *line;
+	uint8_t *buf;
+	UINT br = 0;
+	int i, idx = 0;
+
+	for (i=0; i<SD_CACHE_LINES; i++) {
+		if (sd_cache_line[i].drive == SD_CACHE_UNUSED) {
+			idx = i;
+			break;
+		}
+		if (sd_cache_line[i].stamp < sd_cache_line[idx].stamp) idx = i;
+	}
+	line = &sd_cache_line[idx];
+	buf = sd_cache_data[idx];
+
+	// buffered writes have to reach the disk before reading them back
+	sd_wrbuf_flush_range(drive, lba, count);
+
+	DISKLED_ON;
+	if (img->valid) {
+		// don't seek beyond the end, it would expand a writeable file
+		if (((FSIZE_t)lba << 9) < f_size(&img->file) && IDXSeek(img, lba) == FR_OK)
+			IDXReadMultiple(img, buf, count, &br);
+	} else if (!drive && !umounted) {
+		// the read-ahead must not run past the end of the card, a multi-sector
+		// read across it fails as a whole
+		uint32_t n = count;
+		if (sd_card_size() && lba + n > sd_card_size())
+			n = lba < sd_card_size() ? sd_card_size() - lba : 0;
+		if (n && disk_read(fs.pdrv, buf, lba, n) == RES_OK) br = n << 9;
+	}
+	DISKLED_OFF;
+
+	// past the end of the image or card the core gets zeroes
+	if (br < (count << 9)) memset(buf + br, 0, (count << 9) - br);
+
+	line->drive = drive;
+	line->lba = lba;
+	line->count = count;
+	line->stamp = ++sd_cache_stamp;
+	return buf;
+}
+
+// return a buffer holding the requested sectors, reading them if necessary.
+// Sequential runs double the read-ahead depth up to a full line.
+static uint8_t *sd_cache_read(uint8_t drive, uint32_t lba, uint8_t count) {
+	uint8_t *buf;
+
+	if (lba == sd_cache_next[drive]) {
+		if (sd_cache_depth[drive] < SD_CACHE_LINE_SECTORS)
+			sd_cache_depth[drive] <<= 1;
+	} else {
+		sd_cache_depth[drive] = 1;
+	}
+	if (sd_cache_depth[drive] < count) sd_cache_depth[drive] = count;
+	sd_cache_next[drive] = lba + count;
+
+	buf = sd_cache_lookup(drive, lba, count);
+	if (!buf) buf = sd_cache_fill(drive, lba, sd_cache_depth[drive]);
+	return buf;
+}
+
+// load the sectors following the last read, so they are already present
+// for the next request
+static void sd_cache_prefetch(uint8_t drive, uint8_t count) {
+	uint32_t lba = sd_cache_next[drive];
+	IDXFile *img = &sd_image[sd_index(drive)];
+
+	if (img->valid && ((FSIZE_t)lba << 9) >= f_size(&img->file)) return;
+	if (!img->valid && (drive || umounted)) return;
+	if (!img->valid && sd_card_size() && lba >= sd_card_size()) return;
+	if (!sd_cache_lookup(drive, lba, count))
+		sd_cache_fill(drive, lba, sd_cache_depth[drive]);
+}
+
 char user_io_is_mounted(unsigned char index) {
 	return sd_image[sd_index(index)].valid;
 }
@@ -829,10 +1136,11 @@ char user_io_is_mounted(unsigned char index) {
 void user_io_file_mount(const unsigned char *name, unsigned char index) {
 	FRESULT res;
 
-	buffer_lba = 0xffffffff; // invalidate cache
+	sd_wrbuf_flush(index);
+	sd_cache_invalidate(index); // invalidate cache
 	if (name) {
 		if (sd_image[sd_index(index)].valid)
-			f_close(&sd_image[sd_index(index)].file);
+			IDXClose(&sd_image[sd_index(index)]);
 
 		res = IDXOpen(&sd_image[sd_index(index)], name, FA_READ | FA_WRITE);
 		if (res != FR_OK) res = IDXOpen(&sd_image[sd_index(index)], name, FA_READ);
@@ -848,7 +1156,7 @@ void user_io_file_mount(const unsigned char *name, unsigned char index) {
 		}
 	} else {
 		iprintf("unmounting file in slot %d\n", index);
-		if (sd_image[sd_index(index)].valid) f_close(&sd_image[sd_index(index)].file);
+		if (sd_image[sd_index(index)].valid) IDXClose(&sd_image[sd_index(index)]);
 		sd_image[sd_index(index)].valid = 0;
 		if (!index) umounted = 1;
 	}
@@ -1329,11 +1637,12 @@ void user_io_poll() {
 	}
 
 	// poll db9 joysticks
+	static joymapping_cache_t db9_joymap[2];
 	uint16_t joy_state = 0, joy_map = 0;
 
 	if(GetDB9(0, &joy_state)) {
 
-		joy_map = virtual_joystick_mapping(0x00db, 0x0000, joy_state);
+		joy_map = virtual_joystick_mapping_cached(&db9_joymap[0], 0x00db, 0x0000, joy_state);
 
 		uint8_t idx = joystick_renumber(0);
 		uint8_t id = mist_cfg.joystick_db9_fixed_index ? idx : joystick_count();
@@ -1346,7 +1655,7 @@ void user_io_poll() {
 	}
 	if(GetDB9(1, &joy_state)) {
 
-		joy_map = virtual_joystick_mapping(0x00db, 0x0001, joy_state);
+		joy_map = virtual_joystick_mapping_cached(&db9_joymap[1], 0x00db, 0x0001, joy_state);
 
 		uint8_t idx = joystick_renumber(1);
 		uint8_t id = mist_cfg.joystick_db9_fixed_index ? idx : joystick_count() + 1;
@@ -1459,12 +1768,6 @@ void user_io_poll() {
 		}
 	}
 
-	if((core_type == CORE_TYPE_MIST) ||
-	   (core_type == CORE_TYPE_MIST2)) {
-		// do some tos specific monitoring here
-		tos_poll();
-	}
-
 	// serial IO - TODO: merge with MiST2
 	if(core_type == CORE_TYPE_8BIT) {
 		unsigned char c = 1, f, p=0;
@@ -1495,172 +1798,6 @@ void user_io_poll() {
 		DisableIO();
 	}
 
-	if((core_type == CORE_TYPE_8BIT) && (!strcmp(user_io_get_core_name(), "TGFX16") || (core_features & FEAT_PCECD)))
-		pcecd_poll();
-	if((core_type == CORE_TYPE_8BIT) && (core_features & FEAT_NEOCD))
-		neocd_poll();
-
-	// sd card emulation
-	if((core_type == CORE_TYPE_8BIT) ||
-	   (core_type == CORE_TYPE_MIST2) ||
-	   (core_type == CORE_TYPE_ARCHIE))
-	{
-		uint32_t lba;
-		uint8_t drive_index;
-		uint8_t blksz;
-		uint8_t c = user_io_sd_get_status(&lba, &drive_index, &blksz);
-
-		// valid sd commands start with "5x" (old API), or "6x" (new API)
-		// to avoid problems with cores that don't implement this command
-		if((c & 0xf0) == 0x50 || (c & 0xf0) == 0x60) {
-
-#if 0
-			// debug: If the io controller reports and non-sdhc card, then
-			// the core should never set the sdhc flag
-			if((c & 3) && !MMC_IsSDHC() && (c & 0x04))
-				iprintf("WARNING: SDHC access to non-sdhc card\n");
-#endif
-
-			// check if core requests configuration
-			if(c & 0x08) {
-				iprintf("core requests SD config\n");
-				user_io_sd_set_config();
-			}
-
-			// check if system is trying to access a sdhc card from 
-			// a sd/mmc setup
-
-			// check if an SDHC card is inserted
-			if(MMC_IsSDHC()) {
-				static char using_sdhc = 1;
-
-				// SD request and 
-				if(c & 0x03){
-					if (!(c & 0x04)) {
-						if(using_sdhc) {
-							// we have not been using sdhc so far? 
-							// -> complain!
-							ErrorMessage(" This core does not support\n"
-								" SDHC cards. Using them may\n"
-								" lead to data corruption.\n\n"
-								" Please use an SD card <2GB!", 0);
-							using_sdhc = 0;
-						}
-					} else
-						// SDHC request from core is always ok
-						using_sdhc = 1;
-				}
-			}
-
-			// Write to file/SD Card
-			if((c & 0x03) == 0x02) {
-				// only write if the inserted card is not sdhc or
-				// if the core uses sdhc
-				if((!MMC_IsSDHC()) || (c & 0x04)) {
-					if(user_io_dip_switch1())
-						iprintf("SD WR (%d) %d/%d\n", drive_index, lba, 512<<blksz);
-
-					// if we write the sector stored in the read buffer, then
-					// invalidate the cache
-					if(buffer_lba == lba && buffer_drive_index == drive_index) {
-						buffer_lba = 0xffffffff;
-					}
-					user_io_sd_ack(drive_index);
-					// Fetch sector data from FPGA ...
-					spi_uio_cmd_cont(UIO_SECTOR_WR);
-					spi_read(sector_buffer, 512<<blksz);
-					DisableIO();
-
-					// ... and write it to disk
-					DISKLED_ON;
-
-#if 1
-					if(sd_image[sd_index(drive_index)].valid) {
-						if(((f_size(&sd_image[sd_index(drive_index)].file)-1) >> (9+blksz)) >= lba) {
-							IDXSeek(&sd_image[sd_index(drive_index)], (lba<<blksz));
-							IDXWrite(&sd_image[sd_index(drive_index)], sector_buffer, blksz);
-						}
-					} else if (!drive_index && !umounted)
-						disk_write(fs.pdrv, sector_buffer, lba, 1<<blksz);
-#else
-					hexdump(sector_buffer, 32, 0);
-#endif
-
-					DISKLED_OFF;
-				}
-			}
-
-			// Read from file/SD Card
-			if((c & 0x03) == 0x01) {
-
-				if(user_io_dip_switch1())
-					iprintf("SD RD (%d) %d/%d\n", drive_index, lba, 512<<blksz);
-
-				// invalidate cache if it stores data from another drive
-				if (drive_index != buffer_drive_index)
-					buffer_lba = 0xffffffff;
-
-#ifdef HAVE_PSX
-				if ((core_features & FEAT_PSX) && drive_index == 1) {
-					psx_read_cd(drive_index, lba);
-				} else {
-#endif
-				// are we using a file as the sd card image?
-				// (C64 floppy does that ...)
-				if(buffer_lba != lba) {
-					DISKLED_ON;
-					if(sd_image[sd_index(drive_index)].valid) {
-						if(((f_size(&sd_image[sd_index(drive_index)].file)-1) >> (9+blksz)) >= lba) {
-							IDXSeek(&sd_image[sd_index(drive_index)], lba<<blksz);
-							IDXRead(&sd_image[sd_index(drive_index)], cache_buffer, blksz);
-						}
-					} else if (!drive_index && !umounted) {
-						// sector read
-						// read sector from sd card if it is not already present in
-						// the buffer
-						disk_read(fs.pdrv, cache_buffer, lba, 1<<blksz);
-					}
-					buffer_lba = lba;
-					DISKLED_OFF;
-				}
-				if(buffer_lba == lba) {
-					// hexdump(cache_buffer, 512<<blksz, 0);
-					user_io_sd_ack(drive_index);
-					// data is now stored in buffer. send it to fpga
-					spi_uio_cmd_cont(UIO_SECTOR_RD);
-					spi_write(cache_buffer, 512<<blksz);
-					DisableIO();
-
-					// the end of this transfer acknowledges the FPGA internal
-					// sd card emulation
-				}
-
-				// just load the next sector now, so it may be prefetched
-				// for the next request already
-				DISKLED_ON;
-				if(sd_image[sd_index(drive_index)].valid) {
-					// but check if it would overrun on the file
-					if(((f_size(&sd_image[sd_index(drive_index)].file)-1) >> (9+blksz)) > lba) {
-						IDXSeek(&sd_image[sd_index(drive_index)], (lba+1)<<blksz);
-						IDXRead(&sd_image[sd_index(drive_index)], cache_buffer, blksz);
-						buffer_lba = lba + 1;
-					}
-				} else {
-					// sector read
-					// read sector from sd card if it is not already present in
-					// the buffer
-					disk_read(fs.pdrv, cache_buffer, lba+1, 1<<blksz);
-					buffer_lba = lba+1;
-				}
-				buffer_drive_index = drive_index;
-				DISKLED_OFF;
-#ifdef HAVE_PSX
-				}
-#endif
-			}
-		}
-	}
-
 	if((core_type == CORE_TYPE_8BIT) ||
 	   (core_type == CORE_TYPE_MIST2)) {
 
@@ -1756,21 +1893,6 @@ void user_io_poll() {
 	if(core_type == CORE_TYPE_ARCHIE) 
 		archie_poll();
 
-	if(core_features & FEAT_IDE_MASK)
-	{
-		unsigned char  c1;
-
-		EnableFpga();
-		c1 = SPI(0); // cmd request
-		SPI(0);
-		SPI(0);
-		SPI(0);
-		SPI(0);
-		SPI(0);
-		DisableFpga();
-		HandleHDD(c1, 0, 1);
-	}
-
 	if((core_type == CORE_TYPE_MINIMIG2) ||
 	   (core_type == CORE_TYPE_MIST2) ||
 	   (core_type == CORE_TYPE_ARCHIE) ||
@@ -1867,6 +1989,180 @@ void user_io_poll() {
 
 }
 
+// a request poll is due if the core has been active recently, or if the
+// idle interval has passed. The RTT is used as it doesn't wrap for days.
+char user_io_req_poll_due(fpga_req_poll_t *p) {
+	unsigned long now = GetRTTC();
+	return (now - p->req < REQ_POLL_ACTIVE) || (now - p->poll >= REQ_POLL_IDLE);
+}
+
+void user_io_req_poll_done(fpga_req_poll_t *p, char req) {
+	p->poll = GetRTTC();
+	if(req) p->req = p->poll;
+}
+
+// disk and CD requests of the core. The main loop services them between
+// all other tasks, returns 1 if a request was served
+char user_io_poll_storage() {
+	char busy = 0;
+
+	if(((core_type == CORE_TYPE_MIST) ||
+	    (core_type == CORE_TYPE_MIST2)) &&
+	   user_io_req_poll_due(&tos_req_poll)) {
+		// do some tos specific monitoring here
+		char req = tos_poll();
+		user_io_req_poll_done(&tos_req_poll, req);
+		busy |= req;
+	}
+
+	if((core_type == CORE_TYPE_8BIT) && (!strcmp(user_io_get_core_name(), "TGFX16") || (core_features & FEAT_PCECD)))
+		busy |= pcecd_poll();
+	if((core_type == CORE_TYPE_8BIT) && (core_features & FEAT_NEOCD))
+		busy |= neocd_poll();
+
+	// sd card emulation
+	if(((core_type == CORE_TYPE_8BIT) ||
+	    (core_type == CORE_TYPE_MIST2) ||
+	    (core_type == CORE_TYPE_ARCHIE)) &&
+	   user_io_req_poll_due(&sd_req_poll))
+	{
+		uint32_t lba;
+		uint8_t drive_index;
+		uint8_t blksz;
+		uint8_t c = user_io_sd_get_status(&lba, &drive_index, &blksz);
+
+		// valid sd commands start with "5x" (old API), or "6x" (new API)
+		// to avoid problems with cores that don't implement this command
+		user_io_req_poll_done(&sd_req_poll, ((c & 0xf0) == 0x50 || (c & 0xf0) == 0x60) && (c & 0x0b));
+		if((c & 0xf0) == 0x50 || (c & 0xf0) == 0x60) {
+			if(c & 0x03) busy = 1;
+
+#if 0
+			// debug: If the io controller reports and non-sdhc card, then
+			// the core should never set the sdhc flag
+			if((c & 3) && !MMC_IsSDHC() && (c & 0x04))
+				iprintf("WARNING: SDHC access to non-sdhc card\n");
+#endif
+
+			// check if core requests configuration
+			if(c & 0x08) {
+				iprintf("core requests SD config\n");
+				user_io_sd_set_config();
+			}
+
+			// check if system is trying to access a sdhc card from 
+			// a sd/mmc setup
+
+			// check if an SDHC card is inserted
+			if(MMC_IsSDHC()) {
+				static char using_sdhc = 1;
+
+				// SD request and 
+				if(c & 0x03){
+					if (!(c & 0x04)) {
+						if(using_sdhc) {
+							// we have not been using sdhc so far? 
+							// -> complain!
+							ErrorMessage(" This core does not support\n"
+								" SDHC cards. Using them may\n"
+								" lead to data corruption.\n\n"
+								" Please use an SD card <2GB!", 0);
+							using_sdhc = 0;
+						}
+					} else
+						// SDHC request from core is always ok
+						using_sdhc = 1;
+				}
+			}
+
+			// Write to file/SD Card
+			if((c & 0x03) == 0x02) {
+				// only write if the inserted card is not sdhc or
+				// if the core uses sdhc
+				if((!MMC_IsSDHC()) || (c & 0x04)) {
+					if(user_io_dip_switch1())
+						iprintf("SD WR (%d) %d/%d\n", drive_index, lba, 512<<blksz);
+
+					// if we write sectors stored in the read cache, then
+					// invalidate them
+					sd_cache_write(drive_index, sd_sector(drive_index, lba, blksz), 1<<blksz);
+					user_io_sd_ack(drive_index);
+					// Fetch sector data from FPGA ...
+					spi_uio_cmd_cont(UIO_SECTOR_WR);
+					spi_read(sector_buffer, 512<<blksz);
+					DisableIO();
+
+					// ... and write it to disk
+#if 1
+					if(mist_cfg.sd_write_back)
+						sd_wrbuf_write(drive_index, sector_buffer, sd_sector(drive_index, lba, blksz), 1<<blksz);
+					else
+						sd_disk_write(drive_index, sector_buffer, sd_sector(drive_index, lba, blksz), 1<<blksz);
+#else
+					hexdump(sector_buffer, 32, 0);
+#endif
+				}
+			}
+
+			// Read from file/SD Card
+			if((c & 0x03) == 0x01) {
+
+				if(user_io_dip_switch1())
+					iprintf("SD RD (%d) %d/%d\n", drive_index, lba, 512<<blksz);
+
+#ifdef HAVE_PSX
+				if ((core_features & FEAT_PSX) && drive_index == 1) {
+					psx_read_cd(drive_index, lba);
+				} else {
+#endif
+				// are we using a file as the sd card image?
+				// (C64 floppy does that ...)
+				uint8_t *buf = sd_cache_read(drive_index, sd_sector(drive_index, lba, blksz), 1<<blksz);
+
+				// hexdump(buf, 512<<blksz, 0);
+				user_io_sd_ack(drive_index);
+				// data is now stored in buffer. send it to fpga
+				spi_uio_cmd_cont(UIO_SECTOR_RD);
+				spi_write(buf, 512<<blksz);
+				DisableIO();
+
+				// the end of this transfer acknowledges the FPGA internal
+				// sd card emulation
+
+				// just load the next sectors now, so they may be prefetched
+				// for the next request already
+				sd_cache_prefetch(drive_index, 1<<blksz);
+#ifdef HAVE_PSX
+				}
+#endif
+			}
+		}
+
+		// write back buffered sectors when idle
+		sd_wrbuf_poll();
+	}
+
+	if((core_features & FEAT_IDE_MASK) && user_io_req_poll_due(&ide_req_poll))
+	{
+		unsigned char  c1;
+
+		EnableFpga();
+		c1 = SPI(0); // cmd request
+		SPI(0);
+		SPI(0);
+		SPI(0);
+		SPI(0);
+		SPI(0);
+		DisableFpga();
+		HandleHDD(c1, 0, 1);
+		if(c1 & (CMD_IDECMD | CMD_IDEDAT)) busy = 1;
+		// bit 0 requests CD audio data
+		user_io_req_poll_done(&ide_req_poll, c1 & (CMD_IDECMD | CMD_IDEDAT | 0x01));
+	}
+
+	return busy;
+}
+
 char user_io_dip_switch1() {
 	return(((Buttons() & 2)?1:0) || DEBUG_MODE);
 }
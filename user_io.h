@@ -106,6 +106,8 @@
 #define FEAT_BIGOSD     0x2000 // 16 line tall OSD
 #define FEAT_HDMI       0x4000 // HDMI output
 #define FEAT_PSX        0x8000 // PSX-specific CD image handling
+#define FEAT_DIO_DMA    0x30000 // file uploads by DMA (0 - per byte, 1 - slow, 2 - medium, 3 - full speed)
+#define FEAT_DIO_DMA_SHIFT 16
 
 #define JOY_RIGHT       0x01
 #define JOY_LEFT        0x02
@@ -198,6 +200,13 @@ typedef struct {
   uint8_t fifo_stat;       // space in cores input fifo
 } __attribute__ ((packed)) serial_status_t;
 
+// no board signals FPGA disk requests with an interrupt line, so they
+// are polled: continuously while requests come in, once per ms when idle
+typedef struct {
+  unsigned long req;       // time of the last request, ms
+  unsigned long poll;      // time of the last poll, ms
+} fpga_req_poll_t;
+
 void user_io_reset();
 void user_io_init();
 void user_io_detect_core_type();
@@ -208,6 +217,9 @@ char minimig_v1();
 char minimig_v2();
 char user_io_is_8bit_with_config_string();
 void user_io_poll();
+char user_io_poll_storage();
+char user_io_req_poll_due(fpga_req_poll_t *p);
+void user_io_req_poll_done(fpga_req_poll_t *p, char req);
 void user_io_osd_key_enable(char);
 void user_io_serial_tx(char *, uint16_t);
 char *user_io_8bit_get_string(unsigned char);
@@ -228,6 +240,9 @@ void user_io_sd_ack(char drive_index);
 void user_io_eth_send_mac(uint8_t *);
 uint32_t user_io_eth_get_status(void);
 void user_io_eth_send_rx_frame(uint8_t *, uint16_t);
+void user_io_eth_send_rx_start(void);
+void user_io_eth_send_rx_data(const uint8_t *, uint16_t);
+void user_io_eth_send_rx_end(void);
 void user_io_eth_receive_tx_frame(uint8_t *, uint16_t);
 
 // hooks from the usb layer